@@ -0,0 +1,99 @@
+// Compares the broadphases on scenes of randomly placed boxes.
+//
+// Usage: ev_bench [max_bodies]
+//
+// The boxes are spread over an area that grows with the body count, so the
+// number of touching pairs stays proportional to n and the difference between
+// the broadphases shows up as the scaling of the step time.
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include "physics_2d.h"
+
+using namespace ev;
+using namespace std::chrono;
+
+namespace {
+
+struct Scene {
+  phys::World world;
+  std::vector<std::unique_ptr<Body>> bodies{};
+};
+
+void fill_scene(Scene& scene, uint32 nr_bodies) {
+  std::mt19937 rng{1337};
+  real side = 8.0 * sqrt(static_cast<real>(nr_bodies));
+  std::uniform_real_distribution<real> pos{-side / 2.0, side / 2.0};
+  std::uniform_real_distribution<real> size{0.5, 2.5};
+  std::uniform_real_distribution<real> angle{-1.0, 1.0};
+
+  for (uint32 i = 0; i < nr_bodies; ++i) {
+    auto body = std::make_unique<Body>();
+    body->add_polygon(Polygon{size(rng), size(rng)});
+    body->m_pos = Vec2{pos(rng), pos(rng)};
+    body->m_orientation = Rot{angle(rng)};
+    scene.world.add(body.get());
+    scene.bodies.push_back(std::move(body));
+  }
+}
+
+// Returns milliseconds per step
+double time_steps(phys::BroadphaseType type, uint32 nr_bodies) {
+  Scene scene{phys::World{type}};
+  fill_scene(scene, nr_bodies);
+
+  constexpr float dt = 1.0f / 60.0f;
+  constexpr double time_budget_ms = 1000.0;
+  constexpr int max_steps = 200;
+
+  if (type != phys::BroadphaseType::all_pairs) {
+    scene.world.step(dt);  // Warm up, the first step sorts from scratch
+  }
+
+  int steps = 0;
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+  double elapsed_ms = 0.0;
+  while (steps < max_steps && (steps == 0 || elapsed_ms < time_budget_ms)) {
+    scene.world.step(dt);
+    ++steps;
+    elapsed_ms =
+        duration_cast<microseconds>(high_resolution_clock::now() - start)
+            .count() /
+        1000.0;
+  }
+  return elapsed_ms / steps;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint32 max_bodies = argc > 1 ? std::atoi(argv[1]) : 10000;
+
+  const std::pair<const char*, phys::BroadphaseType> broadphases[] = {
+      {"all pairs", phys::BroadphaseType::all_pairs},
+      {"sap", phys::BroadphaseType::sweep_and_prune},
+      {"tree", phys::BroadphaseType::dynamic_tree},
+      {"grid", phys::BroadphaseType::spatial_grid},
+  };
+
+  std::cout << "ms per step" << std::endl << std::setw(8) << "bodies";
+  for (const auto& broadphase : broadphases) {
+    std::cout << std::setw(12) << broadphase.first;
+  }
+  std::cout << std::endl;
+
+  for (uint32 nr_bodies = 10; nr_bodies <= max_bodies; nr_bodies *= 10) {
+    std::cout << std::setw(8) << nr_bodies << std::fixed
+              << std::setprecision(4);
+    for (const auto& broadphase : broadphases) {
+      std::cout << std::setw(12) << time_steps(broadphase.second, nr_bodies)
+                << std::flush;
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Compares the ways of evaluating a population of random creatures on flat
+// ground: a WalkingChallenge per creature, a WalkingBatchChallenge with all
+// of them in one world, and the lockstep PopulationWorld.
+//
+// Usage: ev_population_bench [max_creatures]
+//
+// Prints the time per population for each, and how many creatures ended up
+// with a different fitness or termination than with a WalkingChallenge each.
+// That should always be 0.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include "population_world.h"
+#include "rng.h"
+
+using namespace ev;
+using namespace std::chrono;
+
+namespace {
+
+constexpr float dt = 1.0f / 60.0f;
+
+std::vector<CreatureDNA> random_population(uint32 size) {
+  Rng rng{1337};
+  std::vector<CreatureDNA> dna(size);
+  for (CreatureDNA& creature : dna) {
+    for (int i = 0; i < CreatureDNA::dna_size; ++i) {
+      creature.raw_dna[i] = rng.uniform();
+    }
+  }
+  return dna;
+}
+
+double elapsed_ms(high_resolution_clock::time_point start) {
+  return duration_cast<microseconds>(high_resolution_clock::now() - start)
+             .count() /
+         1000.0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint32 max_creatures = argc > 1 ? std::atoi(argv[1]) : 1024;
+
+  std::cout << std::setw(10) << "creatures" << std::setw(12) << "scalar ms"
+            << std::setw(12) << "batch ms" << std::setw(12) << "lockstep ms"
+            << std::setw(12) << "mismatches" << std::endl;
+
+  for (uint32 size = 16; size <= max_creatures; size *= 4) {
+    std::vector<CreatureDNA> dna = random_population(size);
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    std::vector<real> fitness;
+    std::vector<Termination> termination;
+    for (const CreatureDNA& creature : dna) {
+      WalkingChallenge<RollingWheelCreature> challenge{creature};
+      while (!challenge.step(dt)) {
+      }
+      fitness.push_back(challenge.get_fitness());
+      termination.push_back(challenge.termination());
+    }
+    double scalar_ms = elapsed_ms(start);
+
+    start = high_resolution_clock::now();
+    WalkingBatchChallenge<RollingWheelCreature> batch{dna};
+    while (!batch.step(dt)) {
+    }
+    double batch_ms = elapsed_ms(start);
+
+    start = high_resolution_clock::now();
+    PopulationWorld population{dna};
+    while (!population.step(dt)) {
+    }
+    double lockstep_ms = elapsed_ms(start);
+
+    uint32 mismatches = 0;
+    for (uint32 i = 0; i < size; ++i) {
+      if (batch.get_fitness(i) != fitness[i] ||
+          batch.termination(i) != termination[i]) {
+        ++mismatches;
+      }
+      if (population.get_fitness(i) != fitness[i] ||
+          population.termination(i) != termination[i]) {
+        ++mismatches;
+      }
+    }
+
+    std::cout << std::setw(10) << size << std::fixed << std::setprecision(1)
+              << std::setw(12) << scalar_ms << std::setw(12) << batch_ms
+              << std::setw(12) << lockstep_ms << std::setw(12) << mismatches
+              << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+// Times the sequential impulse solver on a pile of boxes on the ground, without
+// a thread pool and with pools of growing size, and checks that every run ends
+// with the bodies in exactly the same state.
+//
+// Usage: ev_solver_bench [nr_bodies] [max_threads]
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include "physics_2d.h"
+#include "thread_pool.h"
+
+using namespace ev;
+using namespace std::chrono;
+
+namespace {
+
+struct Result {
+  double ms_per_step{0.0};
+  std::vector<Vec2> positions{};
+  std::vector<Vec2> velocities{};
+};
+
+// The boxes start in loose columns above the ground and settle into a pile,
+// which gives many contacts sharing bodies
+Result run(uint32 nr_bodies, ThreadPool* pool) {
+  phys::SolverConfig solver{};
+  solver.type = phys::SolverType::sequential_impulse;
+  phys::World world{phys::BroadphaseType::sweep_and_prune, solver};
+  world.set_thread_pool(pool);
+
+  Body ground{{0.0f, 0.0f}, Plane{{0.0f, 1.0f}}};
+  world.add(&ground);
+  std::mt19937 rng{1337};
+  std::uniform_real_distribution<real> size{0.4, 0.6};
+  std::uniform_real_distribution<real> jitter{-0.1, 0.1};
+  uint32 columns = static_cast<uint32>(sqrt(static_cast<real>(nr_bodies)));
+  std::vector<std::unique_ptr<Body>> bodies{};
+  for (uint32 i = 0; i < nr_bodies; ++i) {
+    auto body = std::make_unique<Body>();
+    body->add_polygon(Polygon{size(rng), size(rng)});
+    body->m_pos = Vec2{1.5f * (i % columns) + jitter(rng),
+                       1.0f + 1.5f * (i / columns)};
+    world.add(body.get());
+    bodies.push_back(std::move(body));
+  }
+
+  constexpr float dt = 1.0f / 60.0f;
+  constexpr int steps = 300;
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+  for (int step = 0; step < steps; ++step) {
+    world.step(dt);
+  }
+  Result result{};
+  result.ms_per_step =
+      duration_cast<microseconds>(high_resolution_clock::now() - start)
+          .count() /
+      1000.0 / steps;
+  for (const auto& body : bodies) {
+    result.positions.push_back(body->m_pos);
+    result.velocities.push_back(body->m_velocity);
+  }
+  return result;
+}
+
+bool same_state(const Result& a, const Result& b) {
+  for (size_t i = 0; i < a.positions.size(); ++i) {
+    if (a.positions[i].x != b.positions[i].x ||
+        a.positions[i].y != b.positions[i].y ||
+        a.velocities[i].x != b.velocities[i].x ||
+        a.velocities[i].y != b.velocities[i].y) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint32 nr_bodies = argc > 1 ? std::atoi(argv[1]) : 4000;
+  uint32 max_threads = argc > 2 ? std::atoi(argv[2]) : 8;
+
+  std::cout << nr_bodies << " bodies, ms per step" << std::endl
+            << std::setw(8) << "threads" << std::setw(12) << "ms"
+            << std::setw(12) << "same" << std::endl
+            << std::fixed << std::setprecision(4);
+
+  Result serial = run(nr_bodies, nullptr);
+  std::cout << std::setw(8) << "none" << std::setw(12) << serial.ms_per_step
+            << std::endl;
+  for (uint32 threads = 1; threads <= max_threads; threads *= 2) {
+    ThreadPool pool{threads};
+    Result result = run(nr_bodies, &pool);
+    std::cout << std::setw(8) << threads << std::setw(12)
+              << result.ms_per_step << std::setw(12)
+              << (same_state(serial, result) ? "yes" : "no") << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+// Counts heap allocations made while stepping a WalkingChallenge, after a
+// warm-up so the persistent buffers have reached their working sizes.
+// Stepping is expected to be allocation free from then on. A persistent
+// buffer (like the pair list) may still grow once or twice as the scene
+// spreads out, but the count must not grow with the number of steps.
+//
+// Usage: ev_alloc_check [steps]
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include "creatures/rolling_wheel.h"
+#include "simulator.h"
+
+namespace {
+std::atomic<uint64_t> g_allocations{0};
+}
+
+void* operator new(size_t size) {
+  ++g_allocations;
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+using namespace ev;
+
+int main(int argc, char** argv) {
+  int steps = argc > 1 ? std::atoi(argv[1]) : 600;
+  constexpr int warmup_steps = 300;
+  constexpr float dt = 1.0f / 60.0f;
+
+  const std::pair<const char*, phys::BroadphaseType> broadphases[] = {
+      {"all pairs", phys::BroadphaseType::all_pairs},
+      {"sap", phys::BroadphaseType::sweep_and_prune},
+      {"tree", phys::BroadphaseType::dynamic_tree},
+      {"grid", phys::BroadphaseType::spatial_grid},
+  };
+  const std::pair<const char*, GroundType> grounds[] = {
+      {"flat", GroundType::flat},
+      {"terrain", GroundType::terrain},
+  };
+
+  CreatureDNA dna{};
+  for (int i = 0; i < CreatureDNA::dna_size; ++i) {
+    dna.raw_dna[i] = (i % 7) / 7.0f;
+  }
+
+  std::cout << std::setw(10) << "broadphase" << std::setw(10) << "ground"
+            << std::setw(14) << "allocations" << std::setw(14) << "arena bytes"
+            << std::endl;
+  for (const auto& broadphase : broadphases) {
+    for (const auto& ground : grounds) {
+      ChallengeConfig config{};
+      config.seconds = 1000;
+      config.nr_bodies = 50;
+      config.broadphase = broadphase.second;
+      config.ground = ground.second;
+      WalkingChallenge<RollingWheelCreature> challenge{dna, config};
+
+      for (int i = 0; i < warmup_steps; ++i) {
+        challenge.step(dt);
+      }
+      uint64_t before = g_allocations;
+      for (int i = 0; i < steps; ++i) {
+        challenge.step(dt);
+      }
+      uint64_t allocations = g_allocations - before;
+
+      std::cout << std::setw(10) << broadphase.first << std::setw(10)
+                << ground.first << std::setw(14) << allocations
+                << std::setw(14)
+                << challenge.getWorld().frame_arena().high_water_mark()
+                << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,165 @@
+// Checks that the sequential impulse solver lets creatures walk at 1/30 s.
+// Random RollingWheelCreatures run on flat ground for 15 s with the legacy
+// solver at 1/30 s as the reference, and with sequential impulses at 1/30 and
+// 1/60 s. Exits with 1 unless, with sequential impulses at 1/30 s:
+// - no creature started upright gets more kinetic energy than with legacy,
+//   and those started off balance don't get more than the most with legacy
+// - creatures started off balance walk: at most a quarter of them stay
+//   within rest_distance of the start, and on average they get at least half
+//   as far as with legacy
+// - they get as far as at 1/60 s, within a factor of 2
+//
+// Started upright, a wheel stands on its bottom leg with sequential impulses,
+// at any step. Its center of mass never leaves the end of that leg, and the
+// contact doesn't tip it like the legacy solver does, so those only count
+// for the kinetic energy.
+//
+// Usage: ev_walk_check [nr_creatures]
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include "creatures/rolling_wheel.h"
+#include "rng.h"
+#include "simulator.h"
+
+using namespace ev;
+
+namespace {
+
+constexpr real seconds = 15.0f;
+constexpr real rest_distance = 0.5f;
+constexpr real tilt = 0.2f;  // Radians, enough to fall off the bottom leg
+
+struct Walk {
+  real distance{0.0f};  // Furthest from the start
+  real peak_kinetic_energy{0.0f};
+};
+
+Walk walk(const CreatureDNA& dna,
+          phys::SolverType solver_type,
+          float dt,
+          real orientation) {
+  phys::SolverConfig solver{};
+  solver.type = solver_type;
+  phys::World world{phys::BroadphaseType::sweep_and_prune, solver};
+  Body ground{{0.0f, 0.0f}, Plane{{0.0f, 1.0f}}};
+  RollingWheelCreature creature{dna};
+  creature.body().m_orientation = Rot{orientation};
+  world.add(&ground);
+  world.add(&creature.body());
+
+  real start = creature.body().m_pos.x;
+  Walk result{};
+  int steps = static_cast<int>(seconds / dt);
+  for (int step = 0; step < steps; ++step) {
+    creature.step(dt);
+    world.step(dt);
+    result.distance =
+        fmax(result.distance, abs(creature.body().m_pos.x - start));
+    result.peak_kinetic_energy =
+        fmax(result.peak_kinetic_energy, world.kinetic_energy());
+  }
+  return result;
+}
+
+struct Summary {
+  uint32 standing{0};  // Never got further than rest_distance
+  real mean_distance{0.0f};
+};
+
+Summary summarize(const std::vector<Walk>& walks) {
+  Summary summary{};
+  for (const Walk& walk : walks) {
+    summary.standing += walk.distance < rest_distance ? 1 : 0;
+    summary.mean_distance += walk.distance / walks.size();
+  }
+  return summary;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint32 nr_creatures = argc > 1 ? std::atoi(argv[1]) : 12;
+
+  Rng rng{99};
+  std::vector<CreatureDNA> population(nr_creatures);
+  for (CreatureDNA& dna : population) {
+    for (int i = 0; i < CreatureDNA::dna_size; ++i) {
+      dna.raw_dna[i] = rng.uniform();
+    }
+  }
+
+  const struct {
+    const char* name;
+    phys::SolverType type;
+    float dt;
+  } runs[] = {
+      {"legacy 1/30", phys::SolverType::legacy, 1.0f / 30.0f},
+      {"si 1/30", phys::SolverType::sequential_impulse, 1.0f / 30.0f},
+      {"si 1/60", phys::SolverType::sequential_impulse, 1.0f / 60.0f},
+  };
+  constexpr int legacy = 0;
+  constexpr int si_30 = 1;
+  constexpr int si_60 = 2;
+
+  std::vector<Walk> upright[3];
+  std::vector<Walk> tilted[3];
+  for (int run = 0; run < 3; ++run) {
+    for (const CreatureDNA& dna : population) {
+      upright[run].push_back(walk(dna, runs[run].type, runs[run].dt, 0.0f));
+      tilted[run].push_back(walk(dna, runs[run].type, runs[run].dt, tilt));
+    }
+  }
+
+  // Peak kinetic energy of the upright ones, the rest off balance
+  std::cout << nr_creatures << " creatures, " << seconds << " s" << std::endl
+            << std::setw(12) << "" << std::setw(12) << "upright ke"
+            << std::setw(12) << "standing" << std::setw(12) << "distance"
+            << std::endl
+            << std::fixed << std::setprecision(2);
+  for (int run = 0; run < 3; ++run) {
+    real peak = 0.0f;
+    for (const Walk& walk : upright[run]) {
+      peak = fmax(peak, walk.peak_kinetic_energy);
+    }
+    Summary summary = summarize(tilted[run]);
+    std::cout << std::setw(12) << runs[run].name << std::setw(12) << peak
+              << std::setw(12) << summary.standing << std::setw(12)
+              << summary.mean_distance << std::endl;
+  }
+
+  bool ok = true;
+  real legacy_peak = 0.0f;
+  for (const Walk& walk : tilted[legacy]) {
+    legacy_peak = fmax(legacy_peak, walk.peak_kinetic_energy);
+  }
+  for (uint32 i = 0; i < nr_creatures; ++i) {
+    if (upright[si_30][i].peak_kinetic_energy >
+            upright[legacy][i].peak_kinetic_energy ||
+        tilted[si_30][i].peak_kinetic_energy > legacy_peak) {
+      std::cout << "creature " << i << " gets more kinetic energy than with "
+                << "legacy" << std::endl;
+      ok = false;
+    }
+  }
+  Summary legacy_summary = summarize(tilted[legacy]);
+  Summary si_30_summary = summarize(tilted[si_30]);
+  Summary si_60_summary = summarize(tilted[si_60]);
+  if (si_30_summary.standing > nr_creatures / 4) {
+    std::cout << "too many creatures stand still" << std::endl;
+    ok = false;
+  }
+  if (si_30_summary.mean_distance < 0.5f * legacy_summary.mean_distance) {
+    std::cout << "creatures don't get as far as with legacy" << std::endl;
+    ok = false;
+  }
+  if (si_30_summary.mean_distance < 0.5f * si_60_summary.mean_distance ||
+      si_30_summary.mean_distance > 2.0f * si_60_summary.mean_distance) {
+    std::cout << "creatures get a different distance at 1/60" << std::endl;
+    ok = false;
+  }
+  std::cout << (ok ? "ok" : "failed") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+#include "broadphase.h"
+#include <algorithm>
+#include <numeric>
+
+namespace ev {
+namespace phys {
+
+void Broadphase::compute_aabbs(const vector<Body*>& bodies) {
+  m_aabbs.resize(bodies.size());
+  m_filters.resize(bodies.size());
+  m_has_exclusive_groups = false;
+  for (uint32 i = 0; i < bodies.size(); ++i) {
+    m_aabbs[i] = bodies[i]->compute_aabb();
+    m_filters[i] = bodies[i]->m_filter;
+    m_has_exclusive_groups |= is_exclusive(i);
+  }
+}
+
+void Broadphase::sort_pairs() {
+  std::sort(m_pairs.begin(), m_pairs.end(),
+            [](const BroadphasePair& lhs, const BroadphasePair& rhs) {
+              return lhs.a < rhs.a || (lhs.a == rhs.a && lhs.b < rhs.b);
+            });
+}
+
+void Broadphase::remove_bodies(const vector<uint32>& new_index) {
+  // Keeps query() and pairs() in line with the new indices until the next
+  // update. Bodies added since the last update aren't in them yet.
+  uint32 kept = 0;
+  for (uint32 i = 0; i < m_aabbs.size() && i < new_index.size(); ++i) {
+    if (new_index[i] != removed_body) {
+      m_aabbs[kept] = m_aabbs[i];
+      m_filters[kept] = m_filters[i];
+      ++kept;
+    }
+  }
+  m_aabbs.resize(kept);
+  m_filters.resize(kept);
+
+  kept = 0;
+  for (const BroadphasePair& pair : m_pairs) {
+    uint32 a = new_index[pair.a];
+    uint32 b = new_index[pair.b];
+    if (a != removed_body && b != removed_body) {
+      m_pairs[kept++] = {a, b};
+    }
+  }
+  m_pairs.resize(kept);
+}
+
+void Broadphase::query(const AABB& aabb, vector<uint32>& result) const {
+  for (uint32 i = 0; i < m_aabbs.size(); ++i) {
+    if (overlaps(m_aabbs[i], aabb)) {
+      result.push_back(i);
+    }
+  }
+}
+
+void AllPairsBroadphase::update(const vector<Body*>& bodies) {
+  compute_aabbs(bodies);  // Only needed for query()
+  m_pairs.clear();
+  for (uint32 i = 0; i < bodies.size(); ++i) {
+    for (uint32 j = i + 1; j < bodies.size(); ++j) {
+      if (can_pair(i, j)) {
+        m_pairs.push_back({i, j});
+      }
+    }
+  }
+}
+
+void SweepAndPrune::update(const vector<Body*>& bodies) {
+  compute_aabbs(bodies);
+
+  if (m_order.size() != bodies.size()) {
+    // Bodies were added or removed, start over from the identity order
+    m_order.resize(bodies.size());
+    std::iota(m_order.begin(), m_order.end(), 0);
+  }
+
+  // Insertion sort, cheap since the order from last step is nearly sorted
+  for (uint32 i = 1; i < m_order.size(); ++i) {
+    uint32 index = m_order[i];
+    real min_x = m_aabbs[index].min.x;
+    uint32 j = i;
+    while (j > 0 && m_aabbs[m_order[j - 1]].min.x > min_x) {
+      m_order[j] = m_order[j - 1];
+      --j;
+    }
+    m_order[j] = index;
+  }
+
+  // Bodies that start at the same x in a group that can't touch itself, like
+  // the creatures of a batch, would make the sweep quadratic. Runs of them
+  // are skipped in one go.
+  uint32 count = static_cast<uint32>(m_order.size());
+  if (m_has_exclusive_groups) {
+    m_group_end.resize(count);
+    for (uint32 i = count; i-- > 0;) {
+      bool grouped = i + 1 < count &&
+                     same_exclusive_group(m_order[i], m_order[i + 1]);
+      m_group_end[i] = grouped ? m_group_end[i + 1] : i + 1;
+    }
+  }
+
+  // Sweep: every body only has to look ahead until the next body starts
+  // after it ends
+  m_pairs.clear();
+  for (uint32 i = 0; i < count; ++i) {
+    const AABB& a = m_aabbs[m_order[i]];
+    bool exclusive = m_has_exclusive_groups && is_exclusive(m_order[i]);
+    for (uint32 j = i + 1; j < count; ++j) {
+      const AABB& b = m_aabbs[m_order[j]];
+      if (b.min.x > a.max.x) {
+        break;
+      }
+      if (exclusive && same_filter(m_order[i], m_order[j])) {
+        j = m_group_end[j] - 1;
+        continue;
+      }
+      if (a.min.y <= b.max.y && b.min.y <= a.max.y &&
+          can_pair(m_order[i], m_order[j])) {
+        m_pairs.push_back({std::min(m_order[i], m_order[j]),
+                           std::max(m_order[i], m_order[j])});
+      }
+    }
+  }
+  sort_pairs();
+}
+
+void SweepAndPrune::reset() {
+  m_order.clear();
+}
+
+void SweepAndPrune::remove_bodies(const vector<uint32>& new_index) {
+  Broadphase::remove_bodies(new_index);
+  if (m_order.size() != new_index.size()) {
+    m_order.clear();  // Not updated since bodies were added, start over
+    return;
+  }
+  uint32 kept = 0;
+  for (uint32 index : m_order) {
+    if (new_index[index] != removed_body) {
+      m_order[kept++] = new_index[index];
+    }
+  }
+  m_order.resize(kept);
+}
+
+void TreeBroadphase::update(const vector<Body*>& bodies) {
+  compute_aabbs(bodies);
+
+  if (m_proxies.size() != bodies.size()) {
+    m_tree.clear();
+    m_proxies.resize(bodies.size());
+    for (uint32 i = 0; i < bodies.size(); ++i) {
+      m_proxies[i] =
+          m_tree.create_proxy(m_aabbs[i], i, m_filters[i].category);
+    }
+  } else {
+    for (uint32 i = 0; i < bodies.size(); ++i) {
+      if (m_tree.categories(m_proxies[i]) != m_filters[i].category) {
+        // The tree nodes cache the categories below them
+        m_tree.destroy_proxy(m_proxies[i]);
+        m_proxies[i] =
+            m_tree.create_proxy(m_aabbs[i], i, m_filters[i].category);
+      } else {
+        m_tree.move_proxy(m_proxies[i], m_aabbs[i]);
+      }
+    }
+  }
+
+  m_pairs.clear();
+  for (uint32 i = 0; i < bodies.size(); ++i) {
+    const AABB& aabb = m_aabbs[i];
+    // Only visits the parts of the tree with categories that i collides with
+    m_tree.query(
+        aabb,
+        [&](int32 proxy) {
+          uint32 j = m_tree.user_data(proxy);
+          // The fat boxes give false positives, so check the tight ones too
+          if (j > i && overlaps(aabb, m_aabbs[j]) && can_pair(i, j)) {
+            m_pairs.push_back({i, j});
+          }
+          return true;
+        },
+        m_filters[i].mask);
+  }
+  sort_pairs();
+}
+
+void TreeBroadphase::reset() {
+  m_tree.clear();
+  m_proxies.clear();
+}
+
+void TreeBroadphase::remove_bodies(const vector<uint32>& new_index) {
+  Broadphase::remove_bodies(new_index);
+  if (m_proxies.size() != new_index.size()) {
+    reset();  // Not updated since bodies were added, start over
+    return;
+  }
+  uint32 kept = 0;
+  for (uint32 i = 0; i < m_proxies.size(); ++i) {
+    if (new_index[i] == removed_body) {
+      m_tree.destroy_proxy(m_proxies[i]);
+    } else {
+      m_tree.set_user_data(m_proxies[i], new_index[i]);
+      m_proxies[kept++] = m_proxies[i];
+    }
+  }
+  m_proxies.resize(kept);
+}
+
+void TreeBroadphase::query(const AABB& aabb, vector<uint32>& result) const {
+  m_tree.query(aabb, [&](int32 proxy) {
+    uint32 i = m_tree.user_data(proxy);
+    if (overlaps(aabb, m_aabbs[i])) {
+      result.push_back(i);
+    }
+    return true;
+  });
+}
+
+SpatialHashGrid::SpatialHashGrid(real cell_size, uint32 max_cells_per_body)
+    : m_inv_cell_size{1.0f / cell_size},
+      m_max_cells_per_body{max_cells_per_body} {}
+
+void SpatialHashGrid::update(const vector<Body*>& bodies) {
+  compute_aabbs(bodies);
+
+  m_entries.clear();
+  m_large_bodies.clear();
+  m_is_large.assign(bodies.size(), false);
+  for (uint32 i = 0; i < bodies.size(); ++i) {
+    const AABB& aabb = m_aabbs[i];
+
+    // Count the cells in real, huge bodies would overflow the int32 cells
+    real cells = (floor(aabb.max.x * m_inv_cell_size) -
+                  floor(aabb.min.x * m_inv_cell_size) + 1) *
+                 (floor(aabb.max.y * m_inv_cell_size) -
+                  floor(aabb.min.y * m_inv_cell_size) + 1);
+    if (cells > m_max_cells_per_body) {
+      m_large_bodies.push_back(i);
+      m_is_large[i] = true;
+      continue;
+    }
+
+    int32 x0 = cell_coord(aabb.min.x);
+    int32 y0 = cell_coord(aabb.min.y);
+    int32 x1 = cell_coord(aabb.max.x);
+    int32 y1 = cell_coord(aabb.max.y);
+    for (int32 y = y0; y <= y1; ++y) {
+      for (int32 x = x0; x <= x1; ++x) {
+        m_entries.push_back({x, y, i, 0});
+      }
+    }
+  }
+
+  // Counting sort of the entries into buckets, table size a power of two
+  uint32 bucket_count = 64;
+  while (bucket_count < 2 * m_entries.size()) {
+    bucket_count *= 2;
+  }
+  m_bucket_start.assign(bucket_count + 1, 0);
+  for (Entry& entry : m_entries) {
+    entry.bucket = hash(entry.cell_x, entry.cell_y) & (bucket_count - 1);
+    ++m_bucket_start[entry.bucket + 1];
+  }
+  for (uint32 bucket = 0; bucket < bucket_count; ++bucket) {
+    m_bucket_start[bucket + 1] += m_bucket_start[bucket];
+  }
+  m_sorted_entries.resize(m_entries.size());
+  for (const Entry& entry : m_entries) {
+    // m_bucket_start[bucket] is used as the insert cursor, and ends up at the
+    // start of the next bucket
+    m_sorted_entries[m_bucket_start[entry.bucket]++] = entry;
+  }
+
+  m_pairs.clear();
+  m_group_end.resize(m_sorted_entries.size());
+  uint32 bucket_begin = 0;
+  for (uint32 bucket = 0; bucket < bucket_count; ++bucket) {
+    uint32 bucket_end = m_bucket_start[bucket];
+    // Bodies of an exclusive group crowding the same cells, like the
+    // creatures of a batch, are skipped a run at a time. Their entries are
+    // next to each other when their body indices are.
+    for (uint32 p = bucket_end; m_has_exclusive_groups && p-- > bucket_begin;) {
+      bool grouped = p + 1 < bucket_end &&
+                     same_exclusive_group(m_sorted_entries[p].body,
+                                          m_sorted_entries[p + 1].body);
+      m_group_end[p] = grouped ? m_group_end[p + 1] : p + 1;
+    }
+    for (uint32 p = bucket_begin; p < bucket_end; ++p) {
+      const Entry& entry_a = m_sorted_entries[p];
+      bool exclusive = m_has_exclusive_groups && is_exclusive(entry_a.body);
+      for (uint32 q = p + 1; q < bucket_end; ++q) {
+        const Entry& entry_b = m_sorted_entries[q];
+        if (exclusive && same_filter(entry_a.body, entry_b.body)) {
+          q = m_group_end[q] - 1;
+          continue;
+        }
+        if (entry_a.cell_x != entry_b.cell_x ||
+            entry_a.cell_y != entry_b.cell_y) {
+          continue;  // Hash collision
+        }
+        const AABB& a = m_aabbs[entry_a.body];
+        const AABB& b = m_aabbs[entry_b.body];
+        if (!overlaps(a, b) || !can_pair(entry_a.body, entry_b.body)) {
+          continue;
+        }
+        // Bodies sharing several cells would be found once per cell. Only
+        // report the pair from the cell holding the corner of the overlap.
+        if (cell_coord(fmax(a.min.x, b.min.x)) != entry_a.cell_x ||
+            cell_coord(fmax(a.min.y, b.min.y)) != entry_a.cell_y) {
+          continue;
+        }
+        m_pairs.push_back({std::min(entry_a.body, entry_b.body),
+                           std::max(entry_a.body, entry_b.body)});
+      }
+    }
+    bucket_begin = bucket_end;
+  }
+
+  for (uint32 large : m_large_bodies) {
+    for (uint32 j = 0; j < bodies.size(); ++j) {
+      if (j == large || (m_is_large[j] && j < large)) {
+        continue;  // Pairs of large bodies are found from the lower index
+      }
+      if (overlaps(m_aabbs[large], m_aabbs[j]) && can_pair(large, j)) {
+        m_pairs.push_back({std::min(large, j), std::max(large, j)});
+      }
+    }
+  }
+  sort_pairs();
+}
+
+std::unique_ptr<Broadphase> make_broadphase(BroadphaseType type) {
+  switch (type) {
+    case BroadphaseType::all_pairs:
+      return std::make_unique<AllPairsBroadphase>();
+    case BroadphaseType::sweep_and_prune:
+      return std::make_unique<SweepAndPrune>();
+    case BroadphaseType::dynamic_tree:
+      return std::make_unique<TreeBroadphase>();
+    case BroadphaseType::spatial_grid:
+      return std::make_unique<SpatialHashGrid>();
+  }
+  return nullptr;
+}
+
+}  // end namespace phys
+}  // end namespace ev
@@ -0,0 +1,164 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "common.h"
+#include "dynamic_tree.h"
+#include "ev_math.h"
+
+namespace ev {
+namespace phys {
+
+// Two bodies whose bounds overlap, as indices into World::objects().
+// Always a < b, so the pair order matches the old all-pairs loop.
+struct BroadphasePair {
+  uint32 a;
+  uint32 b;
+};
+
+// Marks the bodies taken out in the index maps of Broadphase::remove_bodies
+// and ManifoldStore::remove_bodies
+constexpr uint32 removed_body = 0xffffffff;
+
+enum class BroadphaseType {
+  all_pairs,
+  sweep_and_prune,
+  dynamic_tree,
+  spatial_grid
+};
+
+// Finds the body pairs that might be touching, so the narrowphase only has to
+// look at those. Pairs that should_collide() filters out are left out.
+class Broadphase {
+ public:
+  virtual ~Broadphase() = default;
+
+  // Recompute the candidate pairs from the current body positions
+  virtual void update(const vector<Body*>& bodies) = 0;
+
+  // Called when the world drops its bodies
+  virtual void reset() {}
+  // Called when the world takes some bodies out. new_index holds the new
+  // index of every body, or removed_body. The others keep their order, so the
+  // state kept between steps is carried over rather than rebuilt.
+  virtual void remove_bodies(const vector<uint32>& new_index);
+
+  // Sorted by (a, b)
+  const vector<BroadphasePair>& pairs() const { return m_pairs; }
+
+  // Appends the indices of all bodies overlapping aabb, using the body bounds
+  // from the last update
+  virtual void query(const AABB& aabb, vector<uint32>& result) const;
+
+ protected:
+  // Also copies the collision filters, for can_pair
+  void compute_aabbs(const vector<Body*>& bodies);
+  void sort_pairs();
+
+  // should_collide() on the filters from compute_aabbs
+  bool inline can_pair(uint32 i, uint32 j) const {
+    return should_collide(m_filters[i], m_filters[j]);
+  }
+  // Bodies with a filter that rules out its own category, like the creatures
+  // of a batch, never pair with bodies of the same filter. The broadphases
+  // skip over runs of such a group instead of testing every member.
+  bool inline is_exclusive(uint32 i) const {
+    return !should_collide(m_filters[i], m_filters[i]);
+  }
+  bool inline same_filter(uint32 i, uint32 j) const {
+    return m_filters[i].category == m_filters[j].category &&
+           m_filters[i].mask == m_filters[j].mask;
+  }
+  bool inline same_exclusive_group(uint32 i, uint32 j) const {
+    return same_filter(i, j) && is_exclusive(i);
+  }
+
+  vector<AABB> m_aabbs{};
+  vector<CollisionFilter> m_filters{};
+  bool m_has_exclusive_groups{false};  // Any is_exclusive body at all
+  vector<BroadphasePair> m_pairs{};
+};
+
+// Tests every body against every other body. O(n^2), kept as a reference
+class AllPairsBroadphase : public Broadphase {
+ public:
+  void update(const vector<Body*>& bodies) override;
+};
+
+// Sorts the AABBs along x and only tests bodies whose x intervals overlap.
+// The sorted order is kept between steps and repaired with insertion sort,
+// which is close to O(n) when bodies move a little each step.
+class SweepAndPrune : public Broadphase {
+ public:
+  void update(const vector<Body*>& bodies) override;
+  void reset() override;
+  void remove_bodies(const vector<uint32>& new_index) override;
+
+ private:
+  vector<uint32> m_order{};  // Body indices sorted on m_aabbs[i].min.x
+  // For every position in m_order, the next one holding a body that isn't in
+  // the same exclusive group, see same_exclusive_group
+  vector<uint32> m_group_end{};
+};
+
+// Keeps one fat AABB leaf per body in a DynamicTree. Bodies that stay inside
+// their fat box cost nothing to update, and finding the neighbours of a body
+// is a tree query, so there is no sort order to degrade when bodies are spread
+// out or very different in size.
+class TreeBroadphase : public Broadphase {
+ public:
+  explicit TreeBroadphase(real margin = 1.0f) : m_tree{margin} {}
+  void update(const vector<Body*>& bodies) override;
+  void reset() override;
+  void remove_bodies(const vector<uint32>& new_index) override;
+  void query(const AABB& aabb, vector<uint32>& result) const override;
+
+  const DynamicTree& tree() const { return m_tree; }
+
+ private:
+  DynamicTree m_tree;
+  vector<int32> m_proxies{};  // Tree proxy of each body
+};
+
+// Uniform grid hashed into a flat table, rebuilt from scratch every step with
+// a counting sort of (cell, body) entries, so no memory is allocated per cell.
+// Works best when the bodies are of similar size and around a cell across,
+// like debris fields. Bodies covering more than max_cells_per_body cells (the
+// ground) are kept out of the grid and tested against every other body.
+class SpatialHashGrid : public Broadphase {
+ public:
+  explicit SpatialHashGrid(real cell_size = 8.0f,
+                           uint32 max_cells_per_body = 64);
+  void update(const vector<Body*>& bodies) override;
+
+ private:
+  struct Entry {
+    int32 cell_x;
+    int32 cell_y;
+    uint32 body;
+    uint32 bucket;
+  };
+
+  int32 inline cell_coord(real x) const {
+    return static_cast<int32>(floor(x * m_inv_cell_size));
+  }
+  static uint32 inline hash(int32 cell_x, int32 cell_y) {
+    return static_cast<uint32>(cell_x) * 73856093u ^
+           static_cast<uint32>(cell_y) * 19349663u;
+  }
+
+  real m_inv_cell_size{};
+  uint32 m_max_cells_per_body{};
+  vector<Entry> m_entries{};
+  vector<Entry> m_sorted_entries{};  // m_entries grouped by bucket
+  vector<uint32> m_bucket_start{};   // Start of each bucket in m_sorted_entries
+  // For every sorted entry, the next one in its bucket whose body isn't in
+  // the same exclusive group
+  vector<uint32> m_group_end{};
+  vector<uint32> m_large_bodies{};
+  vector<bool> m_is_large{};
+};
+
+std::unique_ptr<Broadphase> make_broadphase(BroadphaseType type);
+
+}  // end namespace phys
+}  // end namespace ev
@@ -1,4 +1,5 @@
 #include "collision.h"
+#include <cassert>
 #include "common.h"
 #include "ev_math.h"
 #include "shapes.h"
@@ -6,63 +7,37 @@
 namespace ev {
 namespace phys {
 
-Vec2 point_to_world(Vec2 point, const Polygon& poly, const Body& body) {
-  point.rotate(poly.rotation());
-  point += poly.m_pos;
-  point.rotate(body.m_orientation);
-  point += body.m_pos;  // world space
-
-  return point;
-}
-
-Vec2 point_from_world(Vec2 point, const Polygon& poly, const Body& body) {
-  point -= body.m_pos;  // world space
-  point.rotate(-body.m_orientation);
-  point -= poly.m_pos;
-  point.rotate(-poly.rotation());
-
-  return point;
-}
-
 inline bool biased_greater_than(real a, real b) {
   const real k_biasRelative = 0.95f;
   const real k_biasAbsolute = 0.01f;
   return a >= b * k_biasRelative + a * k_biasAbsolute;
 }
-// For directional vectors, like normals, we don't want to translate them
-Vec2 dir_to_world(Vec2 point, const Polygon& poly, const Body& body) {
-  point.rotate(poly.rotation());
-  point.rotate(body.m_orientation);
 
-  return point;
-}
+// All the polygon functions below work on the world-space vertices and normals
+// cached by Polygon::update_world_cache, so there is no trig in the loops
 
-Vec2 dir_from_world(Vec2 point, const Polygon& poly, const Body& body) {
-  point.rotate(-body.m_orientation);
-  point.rotate(-poly.rotation());
+// Distance from face i of a to the deepest vertex of b, negative when b
+// reaches behind the face
+real face_separation(const Polygon& a, const Polygon& b, uint32 i) {
+  Vec2 normal = a.world_normal(i);
 
-  return point;
+  // Support point of b in the direction of -normal
+  real min_projection = std::numeric_limits<real>::infinity();
+  for (uint32 j = 0; j < b.vertex_count(); ++j) {
+    min_projection =
+        fmin(min_projection, dot_product(normal, b.world_vertex(j)));
+  }
+
+  return min_projection - dot_product(normal, a.world_vertex(i));
 }
 
-std::pair<real, uint32> find_axis_of_least_penetration(Polygon& a,
-                                                       Body& body_a,
-                                                       Polygon& b,
-                                                       Body& body_b) {
+std::pair<real, uint32> find_axis_of_least_penetration(const Polygon& a,
+                                                       const Polygon& b) {
   real best_distance = -std::numeric_limits<real>::infinity();
   uint32 best_index;
 
   for (uint32 i = 0; i < a.vertex_count(); ++i) {
-    Vec2 normal = a.normal(i);
-    Vec2 a_normal_b_space = dir_to_world(normal, a, body_a);
-    a_normal_b_space = dir_from_world(a_normal_b_space, b, body_b);
-
-    Vec2 extreme = b.getExtremePoint(-a_normal_b_space);
-
-    // Get current vertex from a in b model space
-    Vec2 v = point_to_world(a.vertex(i), a, body_a);
-    v = point_from_world(v, b, body_b);
-
-    real pen_dist = dot_product(a_normal_b_space, extreme - v);
+    real pen_dist = face_separation(a, b, i);
 
     if (pen_dist > best_distance) {
       best_distance = pen_dist;
@@ -73,19 +48,15 @@ std::pair<real, uint32> find_axis_of_least_penetration(Polygon& a,
   return std::make_pair(best_distance, best_index);
 }
 
-uint32 find_incident_face(Polygon& ref_poly,
-                          Body& ref_body,
-                          Polygon& inc_poly,
-                          Body& inc_body,
+uint32 find_incident_face(const Polygon& ref_poly,
+                          const Polygon& inc_poly,
                           uint32 ref_index) {
-  Vec2 ref_normal =
-      dir_to_world(ref_poly.normal(ref_index), ref_poly, ref_body);
-  ref_normal = dir_from_world(ref_normal, inc_poly, inc_body);
+  Vec2 ref_normal = ref_poly.world_normal(ref_index);
 
   uint32 incident_face = 0;
   real min_dot = std::numeric_limits<real>::infinity();
   for (uint32 i = 0; i < inc_poly.vertex_count(); ++i) {
-    real dot = dot_product(ref_normal, inc_poly.normal(i));
+    real dot = dot_product(ref_normal, inc_poly.world_normal(i));
     if (dot < min_dot) {
       min_dot = dot;
       incident_face = i;
@@ -95,18 +66,34 @@ uint32 find_incident_face(Polygon& ref_poly,
   return incident_face;
 }
 
-uint32 clip(Vec2 n, real c, Vec2* face) {
+bool clip_incident_face(const Polygon& ref_poly,
+                        uint32 ref_index,
+                        const Polygon& incident_poly,
+                        uint32 incident_index,
+                        bool flip,
+                        CollisionData& collision_data);
+
+// Feature id of a contact made by clipping the incident face against side
+// plane side (0 or 1) of the reference face, instead of by an incident vertex
+constexpr uint32 clipped_feature = 0x80;
+
+uint32 clip(Vec2 n, real c, Vec2* face, uint32* ids, uint32 side) {
   uint32 clipped = 0;
   Vec2 out[2] = {face[0], face[1]};
+  uint32 out_ids[2] = {ids[0], ids[1]};
 
   real d1 = dot_product(n, out[0]) - c;
   real d2 = dot_product(n, out[1]) - c;
 
   // If negative (behind plane) clip
-  if (d1 <= 0.0f)
+  if (d1 <= 0.0f) {
+    out_ids[clipped] = ids[0];
     out[clipped++] = face[0];
-  if (d2 <= 0.0f)
+  }
+  if (d2 <= 0.0f) {
+    out_ids[clipped] = ids[1];
     out[clipped++] = face[1];
+  }
 
   // If the points are on different sides of the plane
   if (d1 * d2 < 0.0f)  // less than to ignore -0.0f
@@ -115,85 +102,107 @@ uint32 clip(Vec2 n, real c, Vec2* face) {
     // Push interesection point
     real alpha = d1 / (d1 - d2);
     out[clipped] = face[0] + alpha * (face[1] - face[0]);
+    out_ids[clipped] = clipped_feature | side;
     ++clipped;
   }
 
   face[0] = out[0];
   face[1] = out[1];
+  ids[0] = out_ids[0];
+  ids[1] = out_ids[1];
 
   assert(clipped != 3);
 
   return clipped;
 }
 
-bool polygon_vs_polygon(Polygon a, Polygon b, CollisionData& collision_data) {
+bool polygon_vs_polygon(const Polygon& a,
+                        const Polygon& b,
+                        CollisionData& collision_data,
+                        SeparatingAxis* axis) {
+  if (a.is_box() && b.is_box()) {
+    return box_vs_box(a, b, collision_data, axis);
+  }
+
+  // Shapes that were apart last step mostly still are, along the same face
+  if (axis && axis->polygon == 0 &&
+      face_separation(a, b, axis->index) >= 0.0f) {
+    return false;
+  }
+  if (axis && axis->polygon == 1 &&
+      face_separation(b, a, axis->index) >= 0.0f) {
+    return false;
+  }
+
   // Based on the theorem of axis of separation
   uint32 face_a{};
   real penetration_a{};
-  std::tie(penetration_a, face_a) = find_axis_of_least_penetration(
-      a, collision_data.body_a, b, collision_data.body_b);
+  std::tie(penetration_a, face_a) = find_axis_of_least_penetration(a, b);
 
   if (penetration_a >= 0.0f) {
+    if (axis) {
+      *axis = SeparatingAxis{0, face_a};
+    }
     return false;  // No penetration = no collision
   }
 
   uint32 face_b{};
   real penetration_b{};
-  std::tie(penetration_b, face_b) = find_axis_of_least_penetration(
-      b, collision_data.body_b, a, collision_data.body_a);
+  std::tie(penetration_b, face_b) = find_axis_of_least_penetration(b, a);
 
   if (penetration_b >= 0.0f) {
+    if (axis) {
+      *axis = SeparatingAxis{1, face_b};
+    }
     return false;  // No penetration = no collision
   }
+  if (axis) {
+    *axis = SeparatingAxis{};
+  }
 
   uint32 ref_index{};
   bool flip{};
 
-  Polygon* ref_poly;
-  Body* ref_body;
-  Polygon* incident_poly;
-  Body* incident_body;
+  const Polygon* ref_poly;
+  const Polygon* incident_poly;
 
   if (biased_greater_than(penetration_a, penetration_b)) {
     flip = false;
     ref_poly = &a;
-    ref_body = &collision_data.body_a;
     incident_poly = &b;
-    incident_body = &collision_data.body_b;
     ref_index = face_a;
   } else {
     flip = true;
     ref_poly = &b;
-    ref_body = &collision_data.body_b;
     incident_poly = &a;
-    incident_body = &collision_data.body_a;
     ref_index = face_b;
   }
 
-  uint32 incident_face_index = find_incident_face(
-      *ref_poly, *ref_body, *incident_poly, *incident_body, ref_index);
-
-  int if0_i = incident_face_index;
-  int if1_i = if0_i + 1 >= static_cast<int>(incident_poly->m_vertices.size())
-                  ? 0
-                  : if0_i + 1;
-  Vec2 incident_face[2] = {incident_poly->m_vertices[if0_i],
-                           incident_poly->m_vertices[if1_i]};
-
-  incident_face[0] =
-      point_to_world(incident_face[0], *incident_poly, *incident_body);
-
-  incident_face[1] =
-      point_to_world(incident_face[1], *incident_poly, *incident_body);
+  uint32 incident_face_index =
+      find_incident_face(*ref_poly, *incident_poly, ref_index);
 
-  int rf0_i = ref_index;
-  int rf1_i = rf0_i + 1 >= static_cast<int>(ref_poly->m_vertices.size())
-                  ? 0
-                  : rf0_i + 1;
-  Vec2 ref_face[2] = {ref_poly->m_vertices[rf0_i], ref_poly->m_vertices[rf1_i]};
+  return clip_incident_face(*ref_poly, ref_index, *incident_poly,
+                            incident_face_index, flip, collision_data);
+}
 
-  Vec2 ref_v0_world = point_to_world(ref_face[0], *ref_poly, *ref_body);
-  Vec2 ref_v1_world = point_to_world(ref_face[1], *ref_poly, *ref_body);
+// Clips the incident face against the side planes of the reference face and
+// keeps the points behind the reference face as contacts
+bool clip_incident_face(const Polygon& ref_poly,
+                        uint32 ref_index,
+                        const Polygon& incident_poly,
+                        uint32 incident_index,
+                        bool flip,
+                        CollisionData& collision_data) {
+  uint32 if0_i = incident_index;
+  uint32 if1_i = if0_i + 1 >= incident_poly.vertex_count() ? 0 : if0_i + 1;
+  Vec2 incident_face[2] = {incident_poly.world_vertex(if0_i),
+                           incident_poly.world_vertex(if1_i)};
+  uint32 incident_ids[2] = {if0_i, if1_i};
+
+  uint32 rf0_i = ref_index;
+  uint32 rf1_i = rf0_i + 1 >= ref_poly.vertex_count() ? 0 : rf0_i + 1;
+  Vec2 ref_v0_world = ref_poly.world_vertex(rf0_i);
+  Vec2 ref_v1_world = ref_poly.world_vertex(rf1_i);
 
   Vec2 ref_face_tangent = (ref_v1_world - ref_v0_world);
   ref_face_tangent.normalize();
@@ -210,15 +219,18 @@ bool polygon_vs_polygon(Polygon a, Polygon b, CollisionData& collision_data) {
   real neg_side = -dot_product(ref_face_tangent, ref_v0_world);
   real pos_side = dot_product(ref_face_tangent, ref_v1_world);
 
-  if (clip(-ref_face_tangent, neg_side, incident_face) < 2) {
+  if (clip(-ref_face_tangent, neg_side, incident_face, incident_ids, 0) < 2) {
     return false;  // Can apparently happen due to realing point errors?
   }
 
-  if (clip(ref_face_tangent, pos_side, incident_face) < 2) {
+  if (clip(ref_face_tangent, pos_side, incident_face, incident_ids, 1) < 2) {
     return false;  // Can apparently happen due to realing point errors?
   }
 
   collision_data.normal = flip ? -ref_face_normal : ref_face_normal;
+  // The reference face and which polygon it is on, with the incident vertex
+  // or clip plane in the low byte
+  uint32 ref_feature = (flip ? 0x10000 : 0) | ref_index << 8;
 
   // Only keep points behind reference face
   uint32 contact_points = 0;
@@ -227,6 +239,7 @@ bool polygon_vs_polygon(Polygon a, Polygon b, CollisionData& collision_data) {
 
   if (separation <= 0.1f) {
     collision_data.contacts[contact_points] = incident_face[0];
+    collision_data.feature_ids[contact_points] = ref_feature | incident_ids[0];
     collision_data.penetration_depth = -separation;
     ++contact_points;
   } else {
@@ -238,6 +251,7 @@ bool polygon_vs_polygon(Polygon a, Polygon b, CollisionData& collision_data) {
 
   if (separation <= 0.1f) {
     collision_data.contacts[contact_points] = incident_face[1];
+    collision_data.feature_ids[contact_points] = ref_feature | incident_ids[1];
     collision_data.penetration_depth += -separation;
     ++contact_points;
     collision_data.penetration_depth /= static_cast<real>(contact_points);
@@ -247,7 +261,346 @@ bool polygon_vs_polygon(Polygon a, Polygon b, CollisionData& collision_data) {
   return true;
 }
 
-bool polygon_vs_circle(Polygon a, Circle b, CollisionData& collision_data) {
+// Index of the box face whose normal is axis * sign, see Polygon::set_rect
+inline uint32 box_face_index(int axis, real sign) {
+  if (axis == 0) {
+    return sign > 0.0f ? 1 : 3;
+  }
+  return sign > 0.0f ? 2 : 0;
+}
+
+bool box_vs_box(const Polygon& a,
+                const Polygon& b,
+                CollisionData& collision_data,
+                SeparatingAxis* axis) {
+  // The same separating axis test as polygon_vs_polygon, but with only two
+  // axes per box, and the projection of the other box along an axis taken
+  // from the half extents instead of scanning its vertices
+  Vec2 pos_a = 0.5f * (a.world_vertex(0) + a.world_vertex(2));
+  Vec2 pos_b = 0.5f * (b.world_vertex(0) + b.world_vertex(2));
+  Vec2 axes_a[2] = {a.world_normal(1), a.world_normal(2)};
+  Vec2 axes_b[2] = {b.world_normal(1), b.world_normal(2)};
+  real h_a[2] = {a.half_extents().x, a.half_extents().y};
+  real h_b[2] = {b.half_extents().x, b.half_extents().y};
+  Vec2 a_to_b = pos_b - pos_a;
+
+  // Try the axis that separated the boxes last step first, with the same
+  // arithmetic as the full test below
+  if (axis && axis->polygon == 0) {
+    Vec2 n = axes_a[axis->index];
+    real separation = fabs(dot_product(n, a_to_b)) - h_a[axis->index] -
+                      fabs(dot_product(n, axes_b[0])) * h_b[0] -
+                      fabs(dot_product(n, axes_b[1])) * h_b[1];
+    if (separation >= 0.0f) {
+      return false;
+    }
+  } else if (axis && axis->polygon == 1) {
+    Vec2 n = axes_b[axis->index];
+    real separation = fabs(dot_product(n, a_to_b)) - h_b[axis->index] -
+                      fabs(dot_product(axes_a[0], n)) * h_a[0] -
+                      fabs(dot_product(axes_a[1], n)) * h_a[1];
+    if (separation >= 0.0f) {
+      return false;
+    }
+  }
+
+  // abs_c[i][j] = |cos| of the angle between the axes i of a and j of b
+  real abs_c[2][2];
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      abs_c[i][j] = fabs(dot_product(axes_a[i], axes_b[j]));
+    }
+  }
+
+  // Separation along the faces of a, negative when penetrating
+  real d_a[2];
+  int axis_a = 0;
+  real penetration_a = -std::numeric_limits<real>::infinity();
+  for (int i = 0; i < 2; ++i) {
+    d_a[i] = dot_product(axes_a[i], a_to_b);
+    real separation = fabs(d_a[i]) - h_a[i] - abs_c[i][0] * h_b[0] -
+                      abs_c[i][1] * h_b[1];
+    if (separation > penetration_a) {
+      penetration_a = separation;
+      axis_a = i;
+    }
+  }
+  if (penetration_a >= 0.0f) {
+    if (axis) {
+      *axis = SeparatingAxis{0, static_cast<uint32>(axis_a)};
+    }
+    return false;
+  }
+
+  real d_b[2];
+  int axis_b = 0;
+  real penetration_b = -std::numeric_limits<real>::infinity();
+  for (int j = 0; j < 2; ++j) {
+    d_b[j] = dot_product(axes_b[j], a_to_b);
+    real separation = fabs(d_b[j]) - h_b[j] - abs_c[0][j] * h_a[0] -
+                      abs_c[1][j] * h_a[1];
+    if (separation > penetration_b) {
+      penetration_b = separation;
+      axis_b = j;
+    }
+  }
+  if (penetration_b >= 0.0f) {
+    if (axis) {
+      *axis = SeparatingAxis{1, static_cast<uint32>(axis_b)};
+    }
+    return false;
+  }
+  if (axis) {
+    *axis = SeparatingAxis{};
+  }
+
+  const Polygon* ref_box;
+  const Polygon* incident_box;
+  uint32 ref_index{};
+  bool flip{};
+  Vec2 ref_normal{};
+  if (biased_greater_than(penetration_a, penetration_b)) {
+    // Face of a pointing towards b
+    flip = false;
+    ref_box = &a;
+    incident_box = &b;
+    real sign = d_a[axis_a] > 0.0f ? 1.0f : -1.0f;
+    ref_index = box_face_index(axis_a, sign);
+    ref_normal = sign * axes_a[axis_a];
+  } else {
+    // Face of b pointing towards a
+    flip = true;
+    ref_box = &b;
+    incident_box = &a;
+    real sign = d_b[axis_b] > 0.0f ? -1.0f : 1.0f;
+    ref_index = box_face_index(axis_b, sign);
+    ref_normal = sign * axes_b[axis_b];
+  }
+
+  // The incident face is the one most anti-parallel to the reference normal
+  real dot_x = dot_product(ref_normal, incident_box->world_normal(1));
+  real dot_y = dot_product(ref_normal, incident_box->world_normal(2));
+  uint32 incident_index = fabs(dot_x) > fabs(dot_y)
+                              ? box_face_index(0, -dot_x)
+                              : box_face_index(1, -dot_y);
+
+  return clip_incident_face(*ref_box, ref_index, *incident_box, incident_index,
+                            flip, collision_data);
+}
+
+bool plane_vs_polygon(const Plane& a,
+                      const Polygon& b,
+                      CollisionData& collision_data) {
+  // Keep the two deepest vertices, which is the face resting on the plane
+  // when the polygon lies flat
+  uint32 deepest[2] = {0, 0};
+  real separation[2] = {std::numeric_limits<real>::infinity(),
+                        std::numeric_limits<real>::infinity()};
+  for (uint32 i = 0; i < b.vertex_count(); ++i) {
+    real distance = a.distance(b.world_vertex(i));
+    if (distance < separation[0]) {
+      deepest[1] = deepest[0];
+      separation[1] = separation[0];
+      deepest[0] = i;
+      separation[0] = distance;
+    } else if (distance < separation[1]) {
+      deepest[1] = i;
+      separation[1] = distance;
+    }
+  }
+
+  if (separation[0] >= 0.0f) {
+    return false;  // No penetration = no collision
+  }
+
+  collision_data.normal = a.world_normal();
+  collision_data.contacts[0] = b.world_vertex(deepest[0]);
+  collision_data.feature_ids[0] = deepest[0];
+  collision_data.penetration_depth = -separation[0];
+  collision_data.contact_count = 1;
+
+  // Same allowance as polygon_vs_polygon for the second point
+  if (separation[1] <= 0.1f) {
+    collision_data.contacts[1] = b.world_vertex(deepest[1]);
+    collision_data.feature_ids[1] = deepest[1];
+    collision_data.penetration_depth =
+        (collision_data.penetration_depth - separation[1]) / 2.0f;
+    collision_data.contact_count = 2;
+  }
+  return true;
+}
+
+bool plane_vs_circle(const Plane& a,
+                     const Circle& b,
+                     CollisionData& collision_data) {
+  const Body& body = collision_data.body_b;
+  Vec2 center = body.m_pos + body.m_orientation.rotate(b.m_pos);
+  real separation = a.distance(center) - b.radius;
+  if (separation >= 0.0f) {
+    return false;
+  }
+
+  collision_data.normal = a.world_normal();
+  collision_data.contacts[0] = center - b.radius * a.world_normal();
+  collision_data.penetration_depth = -separation;
+  collision_data.contact_count = 1;
+  return true;
+}
+
+// Calls callback(point, normal, separation, feature) for every penetration
+// candidate between a heightfield and a polygon: polygon vertices against the
+// segment under them, and terrain samples inside the polygon against its
+// faces. The feature is the vertex index, or the sample index plus
+// heightfield_sample_feature.
+constexpr uint32 heightfield_sample_feature = 0x10000;
+
+template <typename Callback>
+void for_each_heightfield_candidate(const Heightfield& a,
+                                    const Polygon& b,
+                                    const AABB& b_aabb,
+                                    uint32 first,
+                                    uint32 last,
+                                    Callback callback) {
+  for (uint32 i = 0; i < b.vertex_count(); ++i) {
+    Vec2 vertex = b.world_vertex(i);
+    uint32 segment, segment_end;
+    if (!a.segment_range(vertex.x, vertex.x, segment, segment_end)) {
+      continue;
+    }
+    Vec2 normal = a.segment_normal(segment);
+    callback(vertex, normal,
+             dot_product(normal, vertex - a.world_point(segment)), i);
+  }
+
+  for (uint32 sample = first; sample <= last; ++sample) {
+    Vec2 point = a.world_point(sample);
+    if (point.x < b_aabb.min.x || point.x > b_aabb.max.x ||
+        point.y < b_aabb.min.y) {
+      continue;
+    }
+    real separation = -std::numeric_limits<real>::infinity();
+    uint32 face = 0;
+    for (uint32 i = 0; i < b.vertex_count(); ++i) {
+      real distance =
+          dot_product(b.world_normal(i), point - b.world_vertex(i));
+      if (distance > separation) {
+        separation = distance;
+        face = i;
+      }
+    }
+    if (separation < 0.0f) {  // Inside the polygon
+      callback(point, -b.world_normal(face), separation,
+               heightfield_sample_feature + sample);
+    }
+  }
+}
+
+bool heightfield_vs_polygon(const Heightfield& a,
+                            const Polygon& b,
+                            CollisionData& collision_data) {
+  AABB b_aabb = b.compute_aabb();
+  uint32 first, last;
+  if (!a.segment_range(b_aabb.min.x, b_aabb.max.x, first, last)) {
+    return false;
+  }
+
+  // The deepest candidate decides the normal...
+  Vec2 deepest_point{};
+  Vec2 normal{};
+  real deepest = 0.0f;
+  uint32 deepest_feature = 0;
+  for_each_heightfield_candidate(
+      a, b, b_aabb, first, last,
+      [&](Vec2 point, Vec2 n, real separation, uint32 feature) {
+        if (separation < deepest) {
+          deepest = separation;
+          deepest_point = point;
+          normal = n;
+          deepest_feature = feature;
+        }
+      });
+  if (deepest >= 0.0f) {
+    return false;  // No penetration = no collision
+  }
+
+  // ...and the second contact is the next deepest one pushing the same way,
+  // with the same allowance as polygon_vs_polygon
+  Vec2 second_point{};
+  real second = 0.1f;
+  bool has_second = false;
+  uint32 second_feature = 0;
+  for_each_heightfield_candidate(
+      a, b, b_aabb, first, last,
+      [&](Vec2 point, Vec2 n, real separation, uint32 feature) {
+        if (separation <= second && dot_product(n, normal) > 0.95f &&
+            (point - deepest_point).length_squared() > 1e-6f) {
+          second = separation;
+          second_point = point;
+          has_second = true;
+          second_feature = feature;
+        }
+      });
+
+  collision_data.normal = normal;
+  collision_data.contacts[0] = deepest_point;
+  collision_data.feature_ids[0] = deepest_feature;
+  collision_data.penetration_depth = -deepest;
+  collision_data.contact_count = 1;
+  if (has_second) {
+    collision_data.contacts[1] = second_point;
+    collision_data.feature_ids[1] = second_feature;
+    collision_data.penetration_depth = (-deepest - second) / 2.0f;
+    collision_data.contact_count = 2;
+  }
+  return true;
+}
+
+bool heightfield_vs_circle(const Heightfield& a,
+                           const Circle& b,
+                           CollisionData& collision_data) {
+  const Body& body = collision_data.body_b;
+  Vec2 center = body.m_pos + body.m_orientation.rotate(b.m_pos);
+  uint32 first, last;
+  if (!a.segment_range(center.x - b.radius, center.x + b.radius, first,
+                       last)) {
+    return false;
+  }
+
+  real best_distance = b.radius;
+  Vec2 normal{};
+  for (uint32 i = first; i < last; ++i) {
+    Vec2 start = a.world_point(i);
+    Vec2 segment = a.world_point(i + 1) - start;
+    real t = dot_product(center - start, segment) / segment.length_squared();
+    Vec2 closest = start + fmin(fmax(t, 0.0f), 1.0f) * segment;
+
+    Vec2 offset = center - closest;
+    real distance = sqrt(squared_length(offset));
+    Vec2 segment_normal = a.segment_normal(i);
+    Vec2 n = distance > 1e-6f ? offset / distance : segment_normal;
+    if (dot_product(segment_normal, center - start) < 0.0f) {
+      distance = -distance;  // The center is under the surface
+      n = segment_normal;
+    }
+    if (distance < best_distance) {
+      best_distance = distance;
+      normal = n;
+    }
+  }
+  if (best_distance >= b.radius) {
+    return false;
+  }
+
+  collision_data.normal = normal;
+  collision_data.contacts[0] = center - b.radius * normal;
+  collision_data.penetration_depth = b.radius - best_distance;
+  collision_data.contact_count = 1;
+  return true;
+}
+
+bool polygon_vs_circle(const Polygon& a,
+                       const Circle& b,
+                       CollisionData& collision_data) {
   return false;
 }
 
@@ -262,7 +615,9 @@ Vec2 component_clamp(Vec2 min, Vec2 max, Vec2 vec) {
   return vec;
 }
 
-bool AABB_vs_circle(AABB aabb, Circle circle, CollisionData& collision_data) {
+bool AABB_vs_circle(const AABB& aabb,
+                    const Circle& circle,
+                    CollisionData& collision_data) {
   auto aabb_extent = (aabb.max - aabb.min) / 2.0f;
   Vec2 pos_aabb = collision_data.body_a.m_pos + aabb.min +
                   aabb_extent;  // Center of aabb in world space
@@ -320,8 +675,8 @@ bool AABB_vs_circle(AABB aabb, Circle circle, CollisionData& collision_data) {
   return true;
 }
 
-bool AABB_vs_AABB(AABB relative_a,
-                  AABB relative_b,
+bool AABB_vs_AABB(const AABB& relative_a,
+                  const AABB& relative_b,
                   CollisionData& collision_data) {
   // Create new AABB in world space
   AABB abox = relative_a;
@@ -371,8 +726,8 @@ bool AABB_vs_AABB(AABB relative_a,
   return true;
 }
 
-bool circle_vs_circle(Circle circle_a,
-                      Circle circle_b,
+bool circle_vs_circle(const Circle& circle_a,
+                      const Circle& circle_b,
                       CollisionData& collision_data) {
   Vec2 a_pos =
       collision_data.body_a.m_pos + circle_a.m_pos;  // Positions are additive
@@ -15,19 +15,63 @@ struct CollisionData {
   Vec2 contacts[2]{};  // Only convex polygon and m_circles, so max 2 contact
                        // points
   int contact_count{};
+
+  // Which vertex, face or clip plane made each contact, set by the
+  // narrowphase, so the contact solver can tell them apart from step to step
+  uint32 feature_ids[2]{};
+  // Index of the Manifold of the two shapes, set by World. Shapes are named
+  // by their index in the shapes of their body: polygons, circles, planes,
+  // then heightfields.
+  uint32 manifold{};
+};
+
+// The face that separated two polygons the last time they were tested. It
+// usually still does, and then one projection rules the pair out.
+struct SeparatingAxis {
+  int32 polygon{-1};  // 0 for a face of a, 1 for b, -1 for none
+  uint32 index{0};    // The face, or the axis (0 x, 1 y) for box_vs_box
 };
 
 void resolve_collision(CollisionData& collision_data);
 
-bool polygon_vs_polygon(Polygon a, Polygon b, CollisionData& collision_data);
-bool polygon_vs_circle(Polygon a, Circle b, CollisionData& collision_data);
-bool circle_vs_circle(Circle circle_a,
-                      Circle circle_b,
+// Needs the world-space caches of both polygons to be up to date. With axis,
+// the separating axis from the last test is tried first, and updated.
+bool polygon_vs_polygon(const Polygon& a,
+                        const Polygon& b,
+                        CollisionData& collision_data,
+                        SeparatingAxis* axis = nullptr);
+// Fast path for two polygons made by Polygon::set_rect, used by
+// polygon_vs_polygon when both are boxes
+bool box_vs_box(const Polygon& a,
+                const Polygon& b,
+                CollisionData& collision_data,
+                SeparatingAxis* axis = nullptr);
+// The plane must be on body_a. Needs up to date world caches.
+bool plane_vs_polygon(const Plane& a,
+                      const Polygon& b,
+                      CollisionData& collision_data);
+bool plane_vs_circle(const Plane& a,
+                     const Circle& b,
+                     CollisionData& collision_data);
+// The heightfield must be on body_a. Only the samples under b are visited.
+bool heightfield_vs_polygon(const Heightfield& a,
+                            const Polygon& b,
+                            CollisionData& collision_data);
+bool heightfield_vs_circle(const Heightfield& a,
+                           const Circle& b,
+                           CollisionData& collision_data);
+bool polygon_vs_circle(const Polygon& a,
+                       const Circle& b,
+                       CollisionData& collision_data);
+bool circle_vs_circle(const Circle& circle_a,
+                      const Circle& circle_b,
                       CollisionData& collision_data);
-bool AABB_vs_AABB(AABB relative_a,
-                  AABB relative_b,
+bool AABB_vs_AABB(const AABB& relative_a,
+                  const AABB& relative_b,
                   CollisionData& collision_data);
-bool AABB_vs_circle(AABB aabb, Circle circle, CollisionData& collision_data);
+bool AABB_vs_circle(const AABB& aabb,
+                    const Circle& circle,
+                    CollisionData& collision_data);
 
 }  // end namespace phys
 }  // end namespace ev
@@ -1,4 +1,5 @@
 #include "common.h"
+#include <cmath>
 #include "shapes.h"
 namespace ev {
 
@@ -15,6 +16,19 @@ Body::Body(Vec2 pos, Circle circle, Polygon polygon, bool fixed /*=false*/)
   }
 }
 
+Body::Body(Vec2 pos, Plane plane) : m_pos{pos} {
+  m_planes.push_back(plane);
+}
+
+void Body::add_heightfield(Heightfield heightfield) {
+  // Massless as well
+  m_heightfields.push_back(std::move(heightfield));
+}
+
+Body::Body(Vec2 pos, Heightfield heightfield) : m_pos{pos} {
+  m_heightfields.push_back(std::move(heightfield));
+}
+
 void Body::add_circle(Circle circle) {
   m_circles.push_back(circle);
   compute_mass();
@@ -25,13 +39,18 @@ void Body::add_polygon(Polygon polygon) {
   compute_mass();
 }
 
+void Body::add_plane(Plane plane) {
+  // Planes have no mass, they only make sense on fixed bodies
+  m_planes.push_back(plane);
+}
+
 void Body::step(real dt) {
   if (m_mass == 0.0f) {
     return;  // inf mass
   }
   Vec2 gravity{0.0f, -9.0f};
   m_pos += m_velocity * dt;
-  m_orientation += m_angular_velocity * dt;
+  m_orientation.integrate(m_angular_velocity * dt);
   m_velocity += gravity * dt;
   m_angular_velocity += m_torque * angular_mass_inv() * dt;
   for (Polygon& poly : m_polygons) {
@@ -39,39 +58,106 @@ void Body::step(real dt) {
   }
 }
 
-void Body::compute_mass() {
-  struct ShapeProperty {
-    Vec2 pos;
-    real mass;
-    real angular_mass;
-  };
+BodyState Body::state() const {
+  return BodyState{m_pos,          m_velocity,         acceleration,
+                   m_orientation,  m_angular_velocity, m_torque,
+                   m_mass,         m_angular_mass,     m_shape_angular_mass};
+}
 
-  real mass = 0.0;
-  real angular_mass = 0.0;
-  Vec2 center_of_mass{0.0};
+void Body::set_state(const BodyState& state) {
+  m_pos = state.pos;
+  m_velocity = state.velocity;
+  acceleration = state.acceleration;
+  m_orientation = state.orientation;
+  m_angular_velocity = state.angular_velocity;
+  m_torque = state.torque;
+  set_mass(state.mass);
+  set_angular_mass(state.angular_mass);
+  m_shape_angular_mass = state.shape_angular_mass;
+}
 
-  vector<ShapeProperty> shapes{};
+bool Body::is_finite() const {
+  return std::isfinite(m_pos.x) && std::isfinite(m_pos.y) &&
+         std::isfinite(m_velocity.x) && std::isfinite(m_velocity.y) &&
+         std::isfinite(m_orientation.c) && std::isfinite(m_orientation.s) &&
+         std::isfinite(m_angular_velocity);
+}
 
-  for (Circle& circle : m_circles) {
-    real curr_mass = circle.compute_mass(1.0);
-    real curr_angular_mass = circle.compute_angular_mass(curr_mass);
+void Body::update_world_cache() {
+  for (Polygon& polygon : m_polygons) {
+    polygon.update_world_cache(m_pos, m_orientation);
+  }
+  for (Plane& plane : m_planes) {
+    plane.update_world_cache(m_pos, m_orientation);
+  }
+  for (Heightfield& heightfield : m_heightfields) {
+    heightfield.update_world_cache(m_pos);
+  }
+}
 
-    mass += curr_mass;
-    center_of_mass += curr_mass * circle.m_pos;
+AABB Body::compute_aabb() const {
+  if (!m_planes.empty()) {
+    constexpr real huge = 1e30f;
+    return AABB{Vec2{-huge, -huge}, Vec2{huge, huge}};
+  }
 
-    shapes.push_back({circle.m_pos, curr_mass, curr_angular_mass});
+  AABB aabb{m_pos, m_pos};
+  for (const Polygon& polygon : m_polygons) {
+    aabb = combine(aabb, polygon.compute_aabb());
   }
+  for (const Circle& circle : m_circles) {
+    aabb = combine(aabb, circle.compute_aabb(m_pos, m_orientation));
+  }
+  for (const Heightfield& heightfield : m_heightfields) {
+    aabb = combine(aabb, heightfield.compute_aabb());
+  }
+  return aabb;
+}
 
-  for (Polygon& polygon : m_polygons) {
+void Body::compute_mass() {
+  real mass = 0.0;
+  m_shape_angular_mass = 0.0;
+
+  for (const Circle& circle : m_circles) {
+    real curr_mass = circle.compute_mass(1.0);
+    mass += curr_mass;
+    m_shape_angular_mass += circle.compute_angular_mass(curr_mass);
+  }
+
+  for (const Polygon& polygon : m_polygons) {
     real curr_mass, curr_angular_mass = 0.0;
     std::tie(curr_mass, curr_angular_mass) = polygon.compute_mass(1.0);
     mass += curr_mass;
-    center_of_mass += curr_mass * polygon.m_pos;
-
-    shapes.push_back({polygon.m_pos, curr_mass, curr_angular_mass});
+    m_shape_angular_mass += curr_angular_mass;
   }
 
   set_mass(mass);  // Sets m_mass_inv as well.
+  update_mass_distribution();
+}
+
+void Body::update_mass_distribution() {
+  // One pass, summing the angular mass of every shape around the current
+  // local origin with the parallel axis theorem. Moving that sum to the
+  // center of mass afterwards is just another parallel axis step:
+  // I_com = I_origin - M * |com|^2.
+  // The original version took the shape offsets from before the shift to
+  // the center of mass, so it left out that last term and gave bodies whose
+  // shapes were not centered too much angular mass. Fitness values differ
+  // from that version for this reason.
+  Vec2 center_of_mass{0.0};
+  real angular_mass_origin = m_shape_angular_mass;
+
+  for (const Circle& circle : m_circles) {
+    real curr_mass = circle.compute_mass(1.0);
+    center_of_mass += curr_mass * circle.m_pos;
+    angular_mass_origin += curr_mass * circle.m_pos.length_squared();
+  }
+
+  for (const Polygon& polygon : m_polygons) {
+    real curr_mass = polygon.mass(1.0);
+    center_of_mass += curr_mass * polygon.m_pos;
+    angular_mass_origin += curr_mass * polygon.m_pos.length_squared();
+  }
 
   center_of_mass *= m_mass_inv;
   // Move all the objects so center of mass is (0,0)
@@ -83,16 +169,11 @@ void Body::compute_mass() {
   for (Polygon& poly : m_polygons) {
     poly.m_pos -= center_of_mass;
   }
-  m_pos += center_of_mass;
-  center_of_mass = {0, 0};  // CoM is now at the local origin
+  // The shapes moved in body space, so the body moves the same amount in
+  // world space to keep them in place
+  m_pos += m_orientation.rotate(center_of_mass);
 
-  // Sum up angular mass, using the parallel axis theorem
-  // And the fact that the center of mass is now the local origin
-  // so distance between center of masses is just shape.pos.length
-  for (const auto& shape : shapes) {
-    angular_mass +=
-        shape.angular_mass + shape.mass * shape.pos.length_squared();
-  }
-  set_angular_mass(angular_mass);
+  set_angular_mass(angular_mass_origin -
+                   m_mass * center_of_mass.length_squared());
 }
 }  // namespace ev
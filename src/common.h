@@ -14,10 +14,46 @@ using u = std::unique_ptr<T>;
 
 using std::vector;
 
+// Everything about a body that changes while it is simulated. Plain data, so
+// World can keep the state of all its bodies in one array.
+struct BodyState {
+  Vec2 pos;
+  Vec2 velocity;
+  real acceleration;
+  Rot orientation;
+  real angular_velocity;
+  real torque;
+  // Creatures move their shapes around, which changes the angular mass
+  real mass;
+  real angular_mass;
+  real shape_angular_mass;
+};
+
+// The moving part of a polygon or circle, in body space
+struct ShapeState {
+  Vec2 pos;
+  Vec2 velocity;
+};
+
+// Collision filtering bits. By default a body is in the first category and
+// collides with every category.
+struct CollisionFilter {
+  uint32 category{1};
+  uint32 mask{0xffffffff};
+};
+
+// Two bodies collide when each one's mask has the category of the other, so
+// either side can opt out
+inline bool should_collide(const CollisionFilter& a, const CollisionFilter& b) {
+  return (a.category & b.mask) != 0 && (b.category & a.mask) != 0;
+}
+
 class Body {
  public:
   vector<Polygon> m_polygons;
   vector<Circle> m_circles;
+  vector<Plane> m_planes;
+  vector<Heightfield> m_heightfields;
 
   // Linear motion
   Vec2 m_pos{};
@@ -25,19 +61,25 @@ class Body {
   real acceleration{};
 
   // Rotational motion
-  real m_orientation{};  // radians
+  Rot m_orientation{};
   real m_angular_velocity{0.000f};
   real m_torque{};
 
   real restitution{0.2f};  // How bouncy this object is in collisions
 
+  CollisionFilter m_filter{};  // See should_collide()
+
   Body() {}
   ~Body();  // Definition in common.cpp to be able to include shapes.h
 
   Body(Vec2 pos, Circle circle, Polygon polygon, bool fixed = false);
+  Body(Vec2 pos, Plane plane);              // Always fixed
+  Body(Vec2 pos, Heightfield heightfield);  // Always fixed
 
   void add_circle(Circle circle);
   void add_polygon(Polygon polygon);
+  void add_plane(Plane plane);
+  void add_heightfield(Heightfield heightfield);
 
   void inline apply_impulse(Vec2 impulse, Vec2 contact_vector) {
     m_velocity += m_mass_inv * impulse;
@@ -46,7 +88,35 @@ class Body {
   }
 
   void step(real dt);
+
+  real inline kinetic_energy() const {
+    return 0.5f * (m_mass * squared_length(m_velocity) +
+                   m_angular_mass * m_angular_velocity * m_angular_velocity);
+  }
+  // False once the body has blown up into NaN or inf
+  bool is_finite() const;
+
+  // Recomputes mass and angular mass from scratch, and moves the local origin
+  // to the center of mass. Needed whenever shapes are added or removed.
   void compute_mass();
+
+  // Cheaper version of compute_mass for when the shapes have only moved
+  // relative to each other, like the legs of a creature. Reuses the total
+  // mass and the shape inertias, and only redoes the center of mass shift and
+  // the parallel axis terms: O(shapes), without touching any vertices.
+  void update_mass_distribution();
+
+  BodyState state() const;
+  // Also needs the shape states restored and the world cache refreshed
+  void set_state(const BodyState& state);
+
+  // Refreshes the world-space caches of the shapes after the body has moved
+  void update_world_cache();
+
+  // World-space bounds of all shapes on the body, needs an up to date cache.
+  // Planes have no bounds, so bodies with planes get a huge (but finite, to
+  // keep the broadphase arithmetic sane) box that overlaps everything.
+  AABB compute_aabb() const;
   real inline mass() { return m_mass; }
   real inline mass_inv() { return m_mass_inv; }
   void inline set_mass(real mass) {
@@ -74,8 +144,15 @@ class Body {
   real m_mass_inv{0.0f};
   real m_angular_mass{0.0f};
   real m_angular_mass_inv{0.0f};
+
+  // Sum of the shape angular masses around their own centers
+  real m_shape_angular_mass{0.0f};
 };
 
+inline bool should_collide(const Body& a, const Body& b) {
+  return should_collide(a.m_filter, b.m_filter);
+}
+
 struct CreatureDNA {
   constexpr static int dna_size{6 * 8};
   real raw_dna[dna_size];
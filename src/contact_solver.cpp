@@ -0,0 +1,219 @@
+#include "contact_solver.h"
+#include <algorithm>
+#include <utility>
+#include "ev_math.h"
+#include "thread_pool.h"
+
+namespace ev {
+namespace phys {
+
+namespace {
+// Has no mass, so impulses leave it where it is
+bool is_static(Body& body) {
+  return body.mass_inv() == 0.0f && body.angular_mass_inv() == 0.0f;
+}
+}  // namespace
+
+void ContactSolver::solve(const CollisionList& collisions,
+                          std::vector<Manifold>& manifolds,
+                          const std::vector<Body*>& bodies,
+                          real dt,
+                          FrameArena& arena) {
+  if (m_config.type == SolverType::legacy) {
+    for (CollisionData collision : collisions) {
+      resolve_collision(collision);
+    }
+    return;
+  }
+
+  ArenaVector<Constraint> constraints{ArenaAllocator<Constraint>{arena}};
+  constraints.reserve(2 * collisions.size());
+  for (const CollisionData& collision : collisions) {
+    prepare(collision, manifolds[collision.manifold], dt, constraints);
+  }
+  uint32 color_start[max_colors + 2];
+  color(constraints, bodies, arena, color_start);
+
+  if (m_config.warm_starting) {
+    for_each_color(constraints, color_start, [](Constraint& c) {
+      apply(c, c.normal_impulse * c.normal + c.tangent_impulse * c.tangent);
+    });
+  }
+
+  for (uint32 iteration = 0; iteration < m_config.iterations; ++iteration) {
+    for_each_color(constraints, color_start,
+                   [this](Constraint& c) { solve_constraint(c); });
+  }
+
+  // Written back only now, prepare() read the last step's impulses there
+  for (const Constraint& c : constraints) {
+    c.manifold->contacts[c.point] = {c.feature, c.normal_impulse,
+                                     c.tangent_impulse};
+    c.manifold->contact_count = c.point + 1;
+  }
+}
+
+void ContactSolver::color(ArenaVector<Constraint>& constraints,
+                          const std::vector<Body*>& bodies,
+                          FrameArena& arena,
+                          uint32* color_start) const {
+  // Greedy, in constraint order: each constraint takes the first color that
+  // none of its dynamic bodies has yet
+  ArenaVector<uint64_t> body_colors(bodies.size(), 0,
+                                    ArenaAllocator<uint64_t>{arena});
+  uint32 counts[max_colors + 1] = {};
+  for (Constraint& c : constraints) {
+    uint32 ids[2] = {c.manifold->body_a, c.manifold->body_b};
+    uint64_t used = 0;
+    for (uint32 id : ids) {
+      used |= is_static(*bodies[id]) ? 0 : body_colors[id];
+    }
+    c.color = 0;
+    while (c.color < max_colors && (used >> c.color & 1) != 0) {
+      ++c.color;
+    }
+    if (c.color != overflow_color) {
+      for (uint32 id : ids) {
+        body_colors[id] |= is_static(*bodies[id]) ? 0 : uint64_t{1} << c.color;
+      }
+    }
+    ++counts[c.color];
+  }
+
+  // Counting sort, which keeps the constraint order within a color
+  color_start[0] = 0;
+  for (uint32 i = 0; i <= max_colors; ++i) {
+    color_start[i + 1] = color_start[i] + counts[i];
+  }
+  uint32 next[max_colors + 1];
+  std::copy(color_start, color_start + max_colors + 1, next);
+  ArenaVector<Constraint> sorted(constraints.size(), Constraint{},
+                                 ArenaAllocator<Constraint>{arena});
+  for (const Constraint& c : constraints) {
+    sorted[next[c.color]++] = c;
+  }
+  std::swap(constraints, sorted);
+}
+
+template <typename Fn>
+void ContactSolver::for_each_color(ArenaVector<Constraint>& constraints,
+                                   const uint32* color_start,
+                                   const Fn& solve) const {
+  for (uint32 color = 0; color <= max_colors; ++color) {
+    uint32 begin = color_start[color];
+    uint32 count = color_start[color + 1] - begin;
+    if (m_pool != nullptr && color != overflow_color &&
+        count >= 2 * parallel_chunk) {
+      Constraint* first = constraints.data() + begin;
+      m_pool->parallel_for(count, parallel_chunk,
+                           [first, &solve](uint32 chunk_begin, uint32 end) {
+                             for (uint32 i = chunk_begin; i < end; ++i) {
+                               solve(first[i]);
+                             }
+                           });
+    } else {
+      for (uint32 i = begin; i < begin + count; ++i) {
+        solve(constraints[i]);
+      }
+    }
+  }
+}
+
+void ContactSolver::solve_constraint(Constraint& c) const {
+  // Friction first, bounded by the normal impulse of the last iteration
+  Vec2 dv = relative_velocity(c);
+  real max_friction = m_config.friction * c.normal_impulse;
+  real tangent_impulse =
+      c.tangent_impulse - c.tangent_mass * dot_product(dv, c.tangent);
+  tangent_impulse = fmin(fmax(tangent_impulse, -max_friction), max_friction);
+  apply(c, (tangent_impulse - c.tangent_impulse) * c.tangent);
+  c.tangent_impulse = tangent_impulse;
+
+  dv = relative_velocity(c);
+  real normal_velocity = dot_product(dv, c.normal);
+  real normal_impulse = fmax(
+      c.normal_impulse + c.normal_mass * (c.bias - normal_velocity), 0.0f);
+  apply(c, (normal_impulse - c.normal_impulse) * c.normal);
+  c.normal_impulse = normal_impulse;
+}
+
+void ContactSolver::prepare(const CollisionData& collision,
+                            Manifold& manifold,
+                            real dt,
+                            ArenaVector<Constraint>& constraints) const {
+  Body& a = collision.body_a;
+  Body& b = collision.body_b;
+  Vec2 normal = collision.normal;
+  Vec2 tangent{normal.y, -normal.x};
+  Vec2 shape_velocity = b.m_orientation.rotate(collision.shape_b.m_velocity) -
+                        a.m_orientation.rotate(collision.shape_a.m_velocity);
+  real restitution = fmin(a.restitution, b.restitution);
+  real penetration_bias =
+      fmin(m_config.baumgarte / dt *
+               fmax(collision.penetration_depth - m_config.slop, 0.0f),
+           m_config.max_push_velocity);
+
+  for (int i = 0; i < collision.contact_count; ++i) {
+    Constraint c{};
+    c.body_a = &a;
+    c.body_b = &b;
+    c.manifold = &manifold;
+    c.point = i;
+    c.feature = collision.feature_ids[i];
+    c.normal = normal;
+    c.tangent = tangent;
+    c.r_a = collision.contacts[i] - a.m_pos;
+    c.r_b = collision.contacts[i] - b.m_pos;
+    c.shape_velocity = shape_velocity;
+
+    real rn_a = cross_product(c.r_a, normal);
+    real rn_b = cross_product(c.r_b, normal);
+    real rt_a = cross_product(c.r_a, tangent);
+    real rt_b = cross_product(c.r_b, tangent);
+    real mass_inv = a.mass_inv() + b.mass_inv();
+    real normal_mass_inv = mass_inv + rn_a * rn_a * a.angular_mass_inv() +
+                           rn_b * rn_b * b.angular_mass_inv();
+    real tangent_mass_inv = mass_inv + rt_a * rt_a * a.angular_mass_inv() +
+                            rt_b * rt_b * b.angular_mass_inv();
+    c.normal_mass = normal_mass_inv > 0.0f ? 1.0f / normal_mass_inv : 0.0f;
+    c.tangent_mass = tangent_mass_inv > 0.0f ? 1.0f / tangent_mass_inv : 0.0f;
+
+    // Bounce off the velocity the contact came in with, before any impulse
+    real approach = dot_product(relative_velocity(c), normal);
+    real bounce = approach < -m_config.restitution_threshold
+                      ? -restitution * approach
+                      : 0.0f;
+    c.bias = fmax(bounce, penetration_bias);
+
+    if (m_config.warm_starting) {
+      for (int j = 0; j < manifold.contact_count; ++j) {
+        if (manifold.contacts[j].feature == c.feature) {
+          c.normal_impulse = manifold.contacts[j].normal_impulse;
+          c.tangent_impulse = manifold.contacts[j].tangent_impulse;
+        }
+      }
+    }
+    constraints.push_back(c);
+  }
+}
+
+Vec2 ContactSolver::relative_velocity(const Constraint& c) {
+  return c.body_b->m_velocity +
+         cross_product(c.body_b->m_angular_velocity, c.r_b) -
+         c.body_a->m_velocity -
+         cross_product(c.body_a->m_angular_velocity, c.r_a) + c.shape_velocity;
+}
+
+void ContactSolver::apply(Constraint& c, Vec2 impulse) {
+  // Static bodies are shared by constraints of the same color, and would not
+  // move anyway
+  if (!is_static(*c.body_a)) {
+    c.body_a->apply_impulse(-impulse, c.r_a);
+  }
+  if (!is_static(*c.body_b)) {
+    c.body_b->apply_impulse(impulse, c.r_b);
+  }
+}
+
+}  // end namespace phys
+}  // end namespace ev
@@ -0,0 +1,127 @@
+#pragma once
+#include <vector>
+#include "collision.h"
+#include "common.h"
+#include "frame_arena.h"
+#include "manifold.h"
+
+namespace ev {
+class ThreadPool;
+
+namespace phys {
+
+// Collisions found during a step, kept in the world's frame arena
+using CollisionList = ArenaVector<CollisionData>;
+
+enum class SolverType {
+  legacy,              // resolve_collision on every collision, one pass
+  sequential_impulse,  // ContactSolver
+};
+
+struct SolverConfig {
+  SolverType type{SolverType::legacy};
+  uint32 iterations{8};
+  // Start every contact from the impulses it ended the last step with
+  bool warm_starting{true};
+  // Fraction of the penetration beyond slop pushed out per step
+  real baumgarte{0.2f};
+  real slop{0.01f};
+  // Cap on the speed the penetration is pushed out with. The push stays in
+  // the velocity after the overlap is gone, so without it a deep overlap,
+  // like a creature spawned into the ground, launches the body faster the
+  // smaller the time step.
+  real max_push_velocity{1.0f};
+  // Contacts closing slower than this don't bounce, so resting ones settle
+  real restitution_threshold{1.0f};
+  real friction{0.7f};
+};
+
+// Sequential impulses: every contact point is a constraint with accumulated
+// normal and friction impulses. Each iteration visits all of them and applies
+// the change that brings the accumulated impulse to what the point needs,
+// clamped so the normal impulse never pulls and the friction stays inside the
+// Coulomb cone. Penetration is fed back as a velocity bias, capped at
+// max_push_velocity, rather than by moving the bodies. The impulses are kept
+// in the manifold of the shape pair by feature id, so a contact that persists
+// starts the next step from where it ended and stacks converge over several
+// steps instead of within one.
+//
+// The constraints are colored so that no two of a color share a dynamic body,
+// and solved color by color. Within a color the order doesn't matter, so big
+// colors are spread over the thread pool, and the result is the same with or
+// without one and for any number of threads. Static bodies like the ground
+// are never changed by the solver, so they don't tie constraints together.
+class ContactSolver {
+ public:
+  explicit ContactSolver(SolverConfig config = {}) : m_config{config} {}
+
+  const SolverConfig& config() const { return m_config; }
+  void set_config(const SolverConfig& config) { m_config = config; }
+
+  // Solves colors of at least 2 * parallel_chunk constraints on pool, if set
+  void set_thread_pool(ThreadPool* pool) { m_pool = pool; }
+  static constexpr uint32 parallel_chunk = 128;
+
+  // Changes the body velocities to resolve the collisions of this step, and
+  // stores the impulses in their manifolds. bodies are the bodies the
+  // manifolds index. The scratch memory comes from arena.
+  void solve(const CollisionList& collisions,
+             std::vector<Manifold>& manifolds,
+             const std::vector<Body*>& bodies,
+             real dt,
+             FrameArena& arena);
+
+ private:
+  // One contact point of a collision
+  struct Constraint {
+    Body* body_a;
+    Body* body_b;
+    Manifold* manifold;
+    uint32 point;  // Index in the contacts of the collision
+    uint32 feature;
+    Vec2 normal;
+    Vec2 tangent;
+    Vec2 r_a;  // From the centers of mass to the contact point
+    Vec2 r_b;
+    // Velocity of the contact on b relative to a from the shapes moving on
+    // their bodies, like creature legs
+    Vec2 shape_velocity;
+    real normal_mass;
+    real tangent_mass;
+    real bias;  // Normal velocity to reach, for restitution and penetration
+    real normal_impulse;
+    real tangent_impulse;
+    uint32 color;
+  };
+
+  // One bit per color in the masks of the bodies. Constraints whose bodies
+  // have used them all go to the overflow color, solved last on one thread.
+  static constexpr uint32 max_colors = 64;
+  static constexpr uint32 overflow_color = max_colors;
+
+  void prepare(const CollisionData& collision,
+               Manifold& manifold,
+               real dt,
+               ArenaVector<Constraint>& constraints) const;
+  // Sorts constraints by color, and fills color_start with where each color
+  // begins in them, plus the end
+  void color(ArenaVector<Constraint>& constraints,
+             const std::vector<Body*>& bodies,
+             FrameArena& arena,
+             uint32* color_start) const;
+  // Calls solve(c) for every constraint, color by color
+  template <typename Fn>
+  void for_each_color(ArenaVector<Constraint>& constraints,
+                      const uint32* color_start,
+                      const Fn& solve) const;
+  void solve_constraint(Constraint& c) const;
+  // Relative velocity of the contact point on b seen from a
+  static Vec2 relative_velocity(const Constraint& c);
+  static void apply(Constraint& c, Vec2 impulse);
+
+  SolverConfig m_config;
+  ThreadPool* m_pool{nullptr};
+};
+
+}  // end namespace phys
+}  // end namespace ev
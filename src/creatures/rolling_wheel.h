@@ -1,3 +1,4 @@
+#pragma once
 #include <array>
 #include "../common.h"
 
@@ -9,6 +10,13 @@ class RollingWheelCreature {
 
   void step(real dt);
 
+  // What the creature adds to its body state, for challenge snapshots
+  struct State {
+    real time;
+  };
+  State state() const { return State{m_time}; }
+  void set_state(State state) { m_time = state.time; }
+
   static constexpr int m_legs = 8;
   std::array<real, m_legs> m_phase{0};
   std::array<real, m_legs> m_amplitudes{0};
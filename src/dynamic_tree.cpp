@@ -0,0 +1,271 @@
+#include "dynamic_tree.h"
+#include <algorithm>
+#include <cassert>
+
+namespace ev {
+namespace phys {
+
+int32 DynamicTree::allocate_node() {
+  if (m_free_list == null_node) {
+    m_nodes.push_back(Node{});
+    return static_cast<int32>(m_nodes.size() - 1);
+  }
+  int32 node = m_free_list;
+  m_free_list = m_nodes[node].parent;
+  m_nodes[node] = Node{};
+  return node;
+}
+
+void DynamicTree::free_node(int32 node) {
+  m_nodes[node].parent = m_free_list;
+  m_nodes[node].height = -1;
+  m_free_list = node;
+}
+
+int32 DynamicTree::create_proxy(const AABB& aabb,
+                                uint32 user_data,
+                                uint32 categories) {
+  int32 proxy = allocate_node();
+  Vec2 margin{m_margin, m_margin};
+  m_nodes[proxy].aabb = AABB{aabb.min - margin, aabb.max + margin};
+  m_nodes[proxy].user_data = user_data;
+  m_nodes[proxy].categories = categories;
+  insert_leaf(proxy);
+  return proxy;
+}
+
+void DynamicTree::destroy_proxy(int32 proxy) {
+  assert(m_nodes[proxy].is_leaf());
+  remove_leaf(proxy);
+  free_node(proxy);
+}
+
+bool DynamicTree::move_proxy(int32 proxy, const AABB& aabb) {
+  assert(m_nodes[proxy].is_leaf());
+  if (contains(m_nodes[proxy].aabb, aabb)) {
+    return false;  // Still inside the fat box, nothing to do
+  }
+
+  remove_leaf(proxy);
+  Vec2 margin{m_margin, m_margin};
+  m_nodes[proxy].aabb = AABB{aabb.min - margin, aabb.max + margin};
+  insert_leaf(proxy);
+  return true;
+}
+
+void DynamicTree::clear() {
+  m_nodes.clear();
+  m_root = null_node;
+  m_free_list = null_node;
+}
+
+void DynamicTree::insert_leaf(int32 leaf) {
+  if (m_root == null_node) {
+    m_root = leaf;
+    m_nodes[leaf].parent = null_node;
+    return;
+  }
+
+  // Walk down the tree picking the cheapest sibling, measured as the growth
+  // in perimeter (the 2D version of the surface area heuristic)
+  AABB leaf_aabb = m_nodes[leaf].aabb;
+  int32 index = m_root;
+  while (!m_nodes[index].is_leaf()) {
+    const Node& node = m_nodes[index];
+    real area = perimeter(node.aabb);
+    real combined_area = perimeter(combine(node.aabb, leaf_aabb));
+
+    // Cost of making a new parent for this node and the new leaf
+    real cost = 2.0f * combined_area;
+
+    // Minimum cost of pushing the leaf further down the tree
+    real inheritance_cost = 2.0f * (combined_area - area);
+
+    auto descend_cost = [&](int32 child) {
+      const Node& child_node = m_nodes[child];
+      real new_area = perimeter(combine(leaf_aabb, child_node.aabb));
+      if (child_node.is_leaf()) {
+        return new_area + inheritance_cost;
+      }
+      return new_area - perimeter(child_node.aabb) + inheritance_cost;
+    };
+    real cost1 = descend_cost(node.child1);
+    real cost2 = descend_cost(node.child2);
+
+    if (cost < cost1 && cost < cost2) {
+      break;
+    }
+    index = cost1 < cost2 ? node.child1 : node.child2;
+  }
+  int32 sibling = index;
+
+  // Allocate before taking any references, the node vector might grow
+  int32 new_parent = allocate_node();
+  int32 old_parent = m_nodes[sibling].parent;
+  m_nodes[new_parent].parent = old_parent;
+  m_nodes[new_parent].aabb = combine(leaf_aabb, m_nodes[sibling].aabb);
+  m_nodes[new_parent].categories =
+      m_nodes[leaf].categories | m_nodes[sibling].categories;
+  m_nodes[new_parent].height = m_nodes[sibling].height + 1;
+  m_nodes[new_parent].child1 = sibling;
+  m_nodes[new_parent].child2 = leaf;
+  m_nodes[sibling].parent = new_parent;
+  m_nodes[leaf].parent = new_parent;
+
+  if (old_parent == null_node) {
+    m_root = new_parent;
+  } else if (m_nodes[old_parent].child1 == sibling) {
+    m_nodes[old_parent].child1 = new_parent;
+  } else {
+    m_nodes[old_parent].child2 = new_parent;
+  }
+
+  refit_upwards(m_nodes[leaf].parent);
+}
+
+void DynamicTree::remove_leaf(int32 leaf) {
+  if (leaf == m_root) {
+    m_root = null_node;
+    return;
+  }
+
+  int32 parent = m_nodes[leaf].parent;
+  int32 grand_parent = m_nodes[parent].parent;
+  int32 sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2
+                                                 : m_nodes[parent].child1;
+
+  if (grand_parent == null_node) {
+    m_root = sibling;
+    m_nodes[sibling].parent = null_node;
+    free_node(parent);
+    return;
+  }
+
+  // Replace the parent with the sibling
+  if (m_nodes[grand_parent].child1 == parent) {
+    m_nodes[grand_parent].child1 = sibling;
+  } else {
+    m_nodes[grand_parent].child2 = sibling;
+  }
+  m_nodes[sibling].parent = grand_parent;
+  free_node(parent);
+
+  refit_upwards(grand_parent);
+}
+
+void DynamicTree::refit_upwards(int32 index) {
+  while (index != null_node) {
+    index = balance(index);
+
+    Node& node = m_nodes[index];
+    const Node& child1 = m_nodes[node.child1];
+    const Node& child2 = m_nodes[node.child2];
+    node.height = 1 + std::max(child1.height, child2.height);
+    node.aabb = combine(child1.aabb, child2.aabb);
+    node.categories = child1.categories | child2.categories;
+
+    index = node.parent;
+  }
+}
+
+// Rotates the taller child up if the subtree at a is imbalanced.
+// Returns the new root of the subtree.
+int32 DynamicTree::balance(int32 i_a) {
+  Node& a = m_nodes[i_a];
+  if (a.is_leaf() || a.height < 2) {
+    return i_a;
+  }
+
+  int32 i_b = a.child1;
+  int32 i_c = a.child2;
+  Node& b = m_nodes[i_b];
+  Node& c = m_nodes[i_c];
+
+  // Points the parent of a at the node that replaces it
+  auto replace_in_parent = [&](int32 i_new) {
+    if (m_nodes[i_new].parent == null_node) {
+      m_root = i_new;
+    } else if (m_nodes[m_nodes[i_new].parent].child1 == i_a) {
+      m_nodes[m_nodes[i_new].parent].child1 = i_new;
+    } else {
+      m_nodes[m_nodes[i_new].parent].child2 = i_new;
+    }
+  };
+
+  int32 balance = c.height - b.height;
+
+  if (balance > 1) {  // Rotate c up
+    int32 i_f = c.child1;
+    int32 i_g = c.child2;
+    Node& f = m_nodes[i_f];
+    Node& g = m_nodes[i_g];
+
+    c.child1 = i_a;
+    c.parent = a.parent;
+    a.parent = i_c;
+    replace_in_parent(i_c);
+
+    if (f.height > g.height) {
+      c.child2 = i_f;
+      a.child2 = i_g;
+      g.parent = i_a;
+      a.aabb = combine(b.aabb, g.aabb);
+      c.aabb = combine(a.aabb, f.aabb);
+      a.categories = b.categories | g.categories;
+      c.categories = a.categories | f.categories;
+      a.height = 1 + std::max(b.height, g.height);
+      c.height = 1 + std::max(a.height, f.height);
+    } else {
+      c.child2 = i_g;
+      a.child2 = i_f;
+      f.parent = i_a;
+      a.aabb = combine(b.aabb, f.aabb);
+      c.aabb = combine(a.aabb, g.aabb);
+      a.categories = b.categories | f.categories;
+      c.categories = a.categories | g.categories;
+      a.height = 1 + std::max(b.height, f.height);
+      c.height = 1 + std::max(a.height, g.height);
+    }
+    return i_c;
+  }
+
+  if (balance < -1) {  // Rotate b up
+    int32 i_d = b.child1;
+    int32 i_e = b.child2;
+    Node& d = m_nodes[i_d];
+    Node& e = m_nodes[i_e];
+
+    b.child1 = i_a;
+    b.parent = a.parent;
+    a.parent = i_b;
+    replace_in_parent(i_b);
+
+    if (d.height > e.height) {
+      b.child2 = i_d;
+      a.child1 = i_e;
+      e.parent = i_a;
+      a.aabb = combine(c.aabb, e.aabb);
+      b.aabb = combine(a.aabb, d.aabb);
+      a.categories = c.categories | e.categories;
+      b.categories = a.categories | d.categories;
+      a.height = 1 + std::max(c.height, e.height);
+      b.height = 1 + std::max(a.height, d.height);
+    } else {
+      b.child2 = i_e;
+      a.child1 = i_d;
+      d.parent = i_a;
+      a.aabb = combine(c.aabb, d.aabb);
+      b.aabb = combine(a.aabb, e.aabb);
+      a.categories = c.categories | d.categories;
+      b.categories = a.categories | e.categories;
+      a.height = 1 + std::max(c.height, d.height);
+      b.height = 1 + std::max(a.height, e.height);
+    }
+    return i_b;
+  }
+
+  return i_a;
+}
+
+}  // end namespace phys
+}  // end namespace ev
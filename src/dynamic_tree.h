@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include "common.h"
+#include "ev_math.h"
+
+namespace ev {
+namespace phys {
+
+// A bounding volume hierarchy over fattened AABBs, in the style of Box2D's
+// b2DynamicTree. Leaves are only reinserted when the tight AABB of their
+// object escapes the fat one, and the tree is kept balanced with AVL-like
+// rotations while it is refitted on the way back up from an insert/remove.
+class DynamicTree {
+ public:
+  static constexpr int32 null_node = -1;
+
+  explicit DynamicTree(real margin = 1.0f) : m_margin{margin} {}
+
+  // Returns the proxy id of the new leaf. categories are the collision
+  // categories of the object, see query().
+  int32 create_proxy(const AABB& aabb,
+                     uint32 user_data,
+                     uint32 categories = 0xffffffff);
+  void destroy_proxy(int32 proxy);
+
+  // Returns true if the proxy had to be reinserted
+  bool move_proxy(int32 proxy, const AABB& aabb);
+
+  void clear();
+
+  const AABB& fat_aabb(int32 proxy) const { return m_nodes[proxy].aabb; }
+  uint32 user_data(int32 proxy) const { return m_nodes[proxy].user_data; }
+  void set_user_data(int32 proxy, uint32 user_data) {
+    m_nodes[proxy].user_data = user_data;
+  }
+  uint32 categories(int32 proxy) const { return m_nodes[proxy].categories; }
+  int32 height() const {
+    return m_root == null_node ? 0 : m_nodes[m_root].height;
+  }
+
+  // Calls callback(proxy) for every leaf whose fat AABB overlaps aabb and
+  // that is in one of the categories of mask. Every node keeps the categories
+  // of the leaves below it, so subtrees of only other categories are skipped
+  // as a whole. The callback returns false to stop the query early.
+  template <typename Callback>
+  void query(const AABB& aabb,
+             Callback callback,
+             uint32 mask = 0xffffffff) const;
+
+ private:
+  struct Node {
+    AABB aabb{};
+    int32 parent{null_node};  // Next free node when on the free list
+    int32 child1{null_node};
+    int32 child2{null_node};
+    int32 height{0};  // Leaves are 0, free nodes -1
+    uint32 user_data{};
+    uint32 categories{};  // Of this leaf, or all leaves below this node
+
+    bool is_leaf() const { return child1 == null_node; }
+  };
+
+  int32 allocate_node();
+  void free_node(int32 node);
+  void insert_leaf(int32 leaf);
+  void remove_leaf(int32 leaf);
+  void refit_upwards(int32 node);
+  int32 balance(int32 node);
+
+  std::vector<Node> m_nodes{};
+  int32 m_root{null_node};
+  int32 m_free_list{null_node};
+  real m_margin{};
+  mutable std::vector<int32> m_stack{};  // Reused by query
+};
+
+template <typename Callback>
+void DynamicTree::query(const AABB& aabb,
+                        Callback callback,
+                        uint32 mask) const {
+  if (m_root == null_node) {
+    return;
+  }
+  m_stack.clear();
+  m_stack.push_back(m_root);
+  while (!m_stack.empty()) {
+    int32 index = m_stack.back();
+    m_stack.pop_back();
+
+    const Node& node = m_nodes[index];
+    if ((node.categories & mask) == 0 || !overlaps(node.aabb, aabb)) {
+      continue;
+    }
+    if (node.is_leaf()) {
+      if (!callback(index)) {
+        return;
+      }
+    } else {
+      m_stack.push_back(node.child1);
+      m_stack.push_back(node.child2);
+    }
+  }
+}
+
+}  // end namespace phys
+}  // end namespace ev
@@ -1,9 +1,11 @@
 #pragma once
 #include <algorithm>
 #include <chrono>
+#include <thread>
 #include "common.h"
 #include "ev_ui.h"
 #include "evolution.h"
+#include "generation_evaluator.h"
 #include "renderer_opengl.h"
 #include "simulator.h"
 #include "utils.h"
@@ -45,11 +47,13 @@ class Ev : EvBase {
         m_evolutor.generate_fresh_generation(population_count);
     std::vector<double> fitness(population_count);
 
-    int simulated_creatures = 0;
-
     CreatureDNA best_dna{};
 
-    auto challenge = ChallengeType{generation.dna[simulated_creatures]};
+    // The population is evaluated on worker threads, this thread only
+    // renders and breeds
+    GenerationEvaluator<ChallengeType> evaluator{simulation_dt};
+    evaluator.start(generation);
+
     std::vector<std::unique_ptr<ChallengeType>> visible_challenges{};
     for (CreatureDNA dna : generation.dna) {
       visible_challenges.push_back(std::make_unique<ChallengeType>(dna));
@@ -62,23 +66,14 @@ class Ev : EvBase {
     bool show_best = true;
 
     while (!m_renderer.should_close()) {
-      // Keep the invisible simulations running as fast as possible
-      if (challenge.step(simulation_dt)) {
-        fitness[simulated_creatures] = challenge.get_fitness();
-
-        ++simulated_creatures;
-        if (simulated_creatures >= population_count) {
-          best_dna = generation.dna[max_element_index(fitness)];
-          generation = m_evolutor.breed_next_generation(generation, fitness,
-                                                        population_count);
-          simulated_creatures = 0;
-        }
-        // Current simulation done! Switch to next one.
-        challenge.reset(generation.dna[simulated_creatures]);
+      if (evaluator.done()) {
+        fitness = evaluator.fitness();
+        best_dna = generation.dna[max_element_index(fitness)];
+        generation = m_evolutor.breed_next_generation(generation, fitness,
+                                                      population_count);
+        evaluator.start(generation);
       }
 
-      // This loop is hopefully running significantly faster than the render
-      // rate
       high_resolution_clock::time_point now = high_resolution_clock::now();
       double dt =
           duration_cast<nanoseconds>(now - last_tick).count() / 1000000000.0;
@@ -89,7 +84,8 @@ class Ev : EvBase {
       if (dt_accumulator > m_renderer.frame_duration) {
         m_renderer.start_frame();
 
-        ev_ui::generation_info(generation.generation_nr, simulated_creatures,
+        ev_ui::generation_info(generation.generation_nr,
+                               static_cast<int>(evaluator.completed()),
                                m_evolutor.get_max_fitness_plot(), show_best);
         if (show_best) {
           render_world(visible_challenges[0]->getWorld());
@@ -118,6 +114,9 @@ class Ev : EvBase {
             }
           }
         }
+      } else {
+        // Nothing to do until the next frame, leave the cores to the workers
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
       }
     }
   }
@@ -2,6 +2,8 @@
 #include <math.h>
 namespace ev {
 using real = double;
+struct Rot;
+
 struct Vec2 {
   real x;
   real y;
@@ -20,6 +22,7 @@ struct Vec2 {
   double inline length_squared() const { return (x * x + y * y); }
 
   // Returns a copy of the vector with the rotation applied
+  Vec2 inline with_rotation(const Rot& rotation) const;
   Vec2 inline with_rotation(real rotation_radians) const {
     real sn = static_cast<real>(sin(rotation_radians));
     real cs = static_cast<real>(cos(rotation_radians));
@@ -32,6 +35,7 @@ struct Vec2 {
   }
 
   // Rotates vector in-place
+  void inline rotate(const Rot& rotation);
   void inline rotate(real rotation_radians) {
     real sn = static_cast<real>(sin(rotation_radians));
     real cs = static_cast<real>(cos(rotation_radians));
@@ -91,12 +95,111 @@ Vec2 inline operator-(Vec2 vec) {
   return vec;
 }
 
+// A rotation stored as its cosine and sine, so applying it is four
+// multiplications instead of a trip through sin/cos
+struct Rot {
+  real c{1.0f};
+  real s{0.0f};
+
+  Rot() = default;
+  explicit Rot(real angle_radians)
+      : c{static_cast<real>(cos(angle_radians))},
+        s{static_cast<real>(sin(angle_radians))} {}
+
+  static Rot inline from_cos_sin(real c, real s) {
+    Rot rot{};
+    rot.c = c;
+    rot.s = s;
+    return rot;
+  }
+
+  real inline angle() const { return static_cast<real>(atan2(s, c)); }
+
+  // The rotated x and y axes
+  Vec2 inline x_axis() const { return Vec2{c, s}; }
+  Vec2 inline y_axis() const { return Vec2{-s, c}; }
+
+  Vec2 inline rotate(Vec2 v) const {
+    return Vec2{c * v.x - s * v.y, s * v.x + c * v.y};
+  }
+  Vec2 inline inv_rotate(Vec2 v) const {
+    return Vec2{c * v.x + s * v.y, -s * v.x + c * v.y};
+  }
+
+  Rot inline inverse() const { return from_cos_sin(c, -s); }
+
+  // Turns the rotation by delta_angle radians. Meant for the small per-step
+  // angles from integrating angular velocity, where a few terms of the Taylor
+  // series are exact to double precision. Renormalizes to avoid drift.
+  void inline integrate(real delta_angle) {
+    real d = delta_angle;
+    if (fabs(d) > 0.25f) {
+      *this = *this * Rot{d};
+      return;
+    }
+    real d2 = d * d;
+    // Taylor series of cos(d) and sin(d), evaluated inside out
+    real dc = 1.0f - d2 / 90.0f;
+    dc = 1.0f - d2 / 56.0f * dc;
+    dc = 1.0f - d2 / 30.0f * dc;
+    dc = 1.0f - d2 / 12.0f * dc;
+    dc = 1.0f - d2 / 2.0f * dc;
+    real ds = 1.0f - d2 / 110.0f;
+    ds = 1.0f - d2 / 72.0f * ds;
+    ds = 1.0f - d2 / 42.0f * ds;
+    ds = 1.0f - d2 / 20.0f * ds;
+    ds = d * (1.0f - d2 / 6.0f * ds);
+
+    real new_c = c * dc - s * ds;
+    real new_s = s * dc + c * ds;
+    real len_inv =
+        1.0f / static_cast<real>(sqrt(new_c * new_c + new_s * new_s));
+    c = new_c * len_inv;
+    s = new_s * len_inv;
+  }
+
+  // Composition, a * b rotates by b first and then by a
+  friend Rot inline operator*(const Rot& a, const Rot& b) {
+    return from_cos_sin(a.c * b.c - a.s * b.s, a.s * b.c + a.c * b.s);
+  }
+};
+
+Vec2 inline Vec2::with_rotation(const Rot& rotation) const {
+  return rotation.rotate(*this);
+}
+
+void inline Vec2::rotate(const Rot& rotation) {
+  *this = rotation.rotate(*this);
+}
+
 struct AABB {
-  Vec2 min;
-  Vec2 max;
+  Vec2 min{};
+  Vec2 max{};
+  AABB() = default;
   AABB(Vec2 min, Vec2 max) : min{min}, max{max} {}
 };
 
+bool inline overlaps(const AABB& a, const AABB& b) {
+  return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y &&
+         b.min.y <= a.max.y;
+}
+
+// True if inner lies completely inside outer
+bool inline contains(const AABB& outer, const AABB& inner) {
+  return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y &&
+         inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+}
+
+real inline perimeter(const AABB& aabb) {
+  return 2.0f * ((aabb.max.x - aabb.min.x) + (aabb.max.y - aabb.min.y));
+}
+
+// Smallest AABB containing both a and b
+AABB inline combine(const AABB& a, const AABB& b) {
+  return AABB{Vec2{fmin(a.min.x, b.min.x), fmin(a.min.y, b.min.y)},
+              Vec2{fmax(a.max.x, b.max.x), fmax(a.max.y, b.max.y)}};
+}
+
 real inline squared_distance(Vec2 a, Vec2 b) {
   auto x = (a.x - b.x);
   auto y = (a.y - b.y);
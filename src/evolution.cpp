@@ -3,7 +3,7 @@
 
 using namespace arma;
 namespace ev {
-Evolutor::Evolutor() {}
+Evolutor::Evolutor(uint64_t seed) : m_rng{seed} {}
 
 Generation Evolutor::generate_fresh_generation(const int population) {
   auto generation = Generation{};
@@ -11,7 +11,7 @@ Generation Evolutor::generate_fresh_generation(const int population) {
   for (int i = 0; i < population; ++i) {
     auto dna = CreatureDNA{};
     for (int j = 0; j < dna.dna_size; ++j) {
-      dna.raw_dna[j] = static_cast<real>(rand()) / static_cast<real>(RAND_MAX);
+      dna.raw_dna[j] = m_rng.uniform();
     }
     generation.dna.push_back(std::move(dna));
   }
@@ -35,24 +35,23 @@ Generation Evolutor::breed_next_generation(const Generation generation,
     next_generation.dna.push_back(generation.dna[sorted_indices.at(i)]);
   }
 
-  // Get parents from the top 10 percent.
-  auto mom_indices =
-      randi<uvec>(population, distr_param(0.0, population * 0.1));
-  auto dad_indices =
-      randi<uvec>(population, distr_param(0.0, population * 0.1));
+  // Get parents from the top 10 percent (ranks 0 to population / 10).
+  uint32_t parent_ranks = static_cast<uint32_t>(population * 0.1) + 1;
 
   for (int i = 0; i < population; i++) {
-    CreatureDNA mom = generation.dna[sorted_indices.at(mom_indices[i])];
-    CreatureDNA dad = generation.dna[sorted_indices.at(dad_indices[i])];
+    CreatureDNA mom =
+        generation.dna[sorted_indices.at(m_rng.below(parent_ranks))];
+    CreatureDNA dad =
+        generation.dna[sorted_indices.at(m_rng.below(parent_ranks))];
     CreatureDNA kid{};
     for (int dna_i = 0; dna_i < kid.dna_size; ++dna_i) {
       // Randomly pick dna from parent
-      kid.raw_dna[dna_i] = rand() % 2 ? mom.raw_dna[dna_i] : dad.raw_dna[dna_i];
+      kid.raw_dna[dna_i] =
+          m_rng.below(2) ? mom.raw_dna[dna_i] : dad.raw_dna[dna_i];
 
-      if ((rand() % 100) <= 5) {
+      if (m_rng.below(100) <= 5) {
         // Mutation!
-        kid.raw_dna[dna_i] +=
-            static_cast<real>(rand()) / static_cast<real>(RAND_MAX);
+        kid.raw_dna[dna_i] += m_rng.uniform();
       }
     }
     next_generation.dna.push_back(std::move(kid));
@@ -3,12 +3,13 @@
 #include <vector>
 #include "common.h"
 #include "physics_2d.h"
+#include "rng.h"
 
 namespace ev {
 using std::vector;
 class Evolutor {
  public:
-  Evolutor();
+  explicit Evolutor(uint64_t seed = 0);
   Generation generate_fresh_generation(const int population);
   Generation breed_next_generation(const Generation generation,
                                    const std::vector<double> fitness,
@@ -17,5 +18,6 @@ class Evolutor {
 
  private:
   vector<float> m_generational_best_fitness{};
+  Rng m_rng;
 };
 }  // namespace ev
@@ -0,0 +1,111 @@
+#include "fitness_cache.h"
+#include <cstring>
+
+namespace ev {
+
+namespace {
+uint64_t mix(uint64_t x) {
+  // splitmix64 finalizer
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+bool same_dna(const CreatureDNA& a, const CreatureDNA& b) {
+  return std::memcmp(a.raw_dna, b.raw_dna, sizeof(a.raw_dna)) == 0;
+}
+}  // namespace
+
+FitnessCache::FitnessCache(size_t capacity) : m_capacity{capacity} {
+  m_index.reserve(capacity);
+}
+
+uint64_t FitnessCache::hash(const CreatureDNA& dna, uint64_t fingerprint) {
+  // Hash the bit patterns, two genes are only the same if they are bitwise
+  // equal (which is also what decides if the simulation is)
+  static_assert(sizeof(real) <= sizeof(uint64_t), "Genes must fit a word");
+  uint64_t hash = mix(fingerprint);
+  for (real gene : dna.raw_dna) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &gene, sizeof(gene));
+    hash = mix(hash ^ bits);
+  }
+  return hash;
+}
+
+FitnessCache::EntryList::iterator FitnessCache::find(uint64_t key,
+                                                     const CreatureDNA& dna,
+                                                     uint64_t fingerprint) {
+  auto it = m_index.find(key);
+  if (it == m_index.end() || it->second->fingerprint != fingerprint ||
+      !same_dna(it->second->dna, dna)) {
+    return m_entries.end();
+  }
+  return it->second;
+}
+
+bool FitnessCache::lookup(const CreatureDNA& dna,
+                          uint64_t fingerprint,
+                          double& fitness) {
+  uint64_t key = hash(dna, fingerprint);
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto entry = find(key, dna, fingerprint);
+  if (entry == m_entries.end()) {
+    ++m_misses;
+    return false;
+  }
+  m_entries.splice(m_entries.begin(), m_entries, entry);  // Now most recent
+  fitness = entry->fitness;
+  ++m_hits;
+  return true;
+}
+
+void FitnessCache::insert(const CreatureDNA& dna,
+                          uint64_t fingerprint,
+                          double fitness) {
+  if (m_capacity == 0) {
+    return;
+  }
+  uint64_t key = hash(dna, fingerprint);
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto existing = m_index.find(key);
+  if (existing != m_index.end()) {
+    // Same genome simulated twice, or a hash collision: keep the newest
+    m_entries.erase(existing->second);
+    m_index.erase(existing);
+  } else if (m_entries.size() >= m_capacity) {
+    m_index.erase(m_entries.back().key);
+    m_entries.pop_back();
+  }
+  m_entries.push_front(Entry{key, fingerprint, dna, fitness});
+  m_index[key] = m_entries.begin();
+}
+
+void FitnessCache::clear() {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  m_entries.clear();
+  m_index.clear();
+}
+
+size_t FitnessCache::size() const {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_entries.size();
+}
+
+uint64_t FitnessCache::hits() const {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_hits;
+}
+
+uint64_t FitnessCache::misses() const {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_misses;
+}
+
+void FitnessCache::reset_stats() {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  m_hits = 0;
+  m_misses = 0;
+}
+
+}  // namespace ev
@@ -0,0 +1,55 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "common.h"
+
+namespace ev {
+
+// Remembers the fitness of genomes that have already been simulated, so
+// elites and crossover children identical to a parent are not simulated
+// again. Only valid for deterministic challenges: entries are keyed on the
+// DNA and a fingerprint of everything else that decides the outcome.
+//
+// Bounded, the least recently used entry is dropped when full. Thread safe,
+// workers insert their results directly.
+class FitnessCache {
+ public:
+  explicit FitnessCache(size_t capacity = 4096);
+
+  static uint64_t hash(const CreatureDNA& dna, uint64_t fingerprint);
+
+  // Returns true and sets fitness on a hit
+  bool lookup(const CreatureDNA& dna, uint64_t fingerprint, double& fitness);
+  void insert(const CreatureDNA& dna, uint64_t fingerprint, double fitness);
+  void clear();
+
+  size_t size() const;
+  size_t capacity() const { return m_capacity; }
+  uint64_t hits() const;
+  uint64_t misses() const;
+  void reset_stats();
+
+ private:
+  struct Entry {
+    uint64_t key;
+    uint64_t fingerprint;
+    CreatureDNA dna;  // Full copy, so hash collisions can't give wrong hits
+    double fitness;
+  };
+  using EntryList = std::list<Entry>;
+
+  // Finds the entry under m_mutex, or returns m_entries.end()
+  EntryList::iterator find(uint64_t key,
+                           const CreatureDNA& dna,
+                           uint64_t fingerprint);
+
+  size_t m_capacity;
+  mutable std::mutex m_mutex{};
+  EntryList m_entries{};  // Most recently used first
+  std::unordered_map<uint64_t, EntryList::iterator> m_index{};
+  uint64_t m_hits{0};
+  uint64_t m_misses{0};
+};
+
+}  // namespace ev
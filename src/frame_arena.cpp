@@ -0,0 +1,38 @@
+#include "frame_arena.h"
+#include <algorithm>
+
+namespace ev {
+
+FrameArena::FrameArena(size_t initial_capacity) {
+  new_block(initial_capacity);
+}
+
+void FrameArena::new_block(size_t capacity) {
+  m_storage = std::make_unique<std::byte[]>(capacity);
+  m_block = m_storage.get();
+  m_capacity = capacity;
+  m_used = 0;
+  ++m_heap_allocations;
+}
+
+void* FrameArena::allocate_slow(size_t bytes, size_t alignment) {
+  // Keep the full block alive until reset, its memory is still in use
+  m_retired_bytes += m_used;
+  m_retired.push_back(std::move(m_storage));
+  new_block(std::max(2 * m_capacity, bytes + alignment));
+  return allocate(bytes, alignment);
+}
+
+void FrameArena::reset() {
+  size_t used = bytes_used();
+  m_high_water_mark = std::max(m_high_water_mark, used);
+  if (!m_retired.empty()) {
+    // This step did not fit, replace the chain with one block that fits it
+    m_retired.clear();
+    m_retired_bytes = 0;
+    new_block(std::max(m_capacity, m_high_water_mark));
+  }
+  m_used = 0;
+}
+
+}  // namespace ev
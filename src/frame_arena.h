@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ev {
+
+// Linear allocator for scratch memory that only lives for one step.
+// Allocating is a pointer bump and nothing is freed individually; reset()
+// releases everything at once. When a step needs more than the current block
+// the arena chains extra blocks, and the next reset() merges them into one
+// block big enough for the whole step, so after a few steps it stops touching
+// the heap entirely.
+class FrameArena {
+ public:
+  explicit FrameArena(size_t initial_capacity = 64 * 1024);
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+  FrameArena(FrameArena&&) = default;
+  FrameArena& operator=(FrameArena&&) = default;
+
+  void* allocate(size_t bytes, size_t alignment) {
+    uintptr_t current = reinterpret_cast<uintptr_t>(m_block) + m_used;
+    uintptr_t aligned = (current + alignment - 1) & ~(alignment - 1);
+    size_t end = m_used + (aligned - current) + bytes;
+    if (end > m_capacity) {
+      return allocate_slow(bytes, alignment);
+    }
+    m_used = end;
+    return reinterpret_cast<void*>(aligned);
+  }
+
+  // Frees everything allocated since the last reset
+  void reset();
+
+  // Bytes handed out since the last reset, counting alignment padding
+  size_t bytes_used() const { return m_retired_bytes + m_used; }
+  // Most bytes used between two resets so far
+  size_t high_water_mark() const { return m_high_water_mark; }
+  size_t capacity() const { return m_capacity; }
+  // Number of times the arena had to go to the heap for a block
+  uint64_t heap_allocations() const { return m_heap_allocations; }
+
+ private:
+  void* allocate_slow(size_t bytes, size_t alignment);
+  void new_block(size_t capacity);
+
+  std::unique_ptr<std::byte[]> m_storage{};
+  std::byte* m_block{nullptr};
+  size_t m_capacity{0};
+  size_t m_used{0};
+
+  // Blocks filled up during this step, freed on reset
+  std::vector<std::unique_ptr<std::byte[]>> m_retired{};
+  size_t m_retired_bytes{0};
+
+  size_t m_high_water_mark{0};
+  uint64_t m_heap_allocations{0};
+};
+
+// Standard allocator on top of a FrameArena, so containers can keep their
+// per-step data in it. deallocate is a no-op, the memory comes back on reset.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(FrameArena& arena) : m_arena{&arena} {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : m_arena{other.arena()} {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+
+  FrameArena* arena() const { return m_arena; }
+
+ private:
+  FrameArena* m_arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // namespace ev
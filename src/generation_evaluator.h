@@ -0,0 +1,516 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "fitness_cache.h"
+#include "population_world.h"
+#include "simulator.h"
+#include "thread_pool.h"
+
+namespace ev {
+
+// Fitness racing: every checkpoint_steps steps a creature is dropped if it
+// could not beat the elite cutoff (the lowest fitness among the best
+// elite_fraction of the creatures finished so far) even if it moved
+// max_speed units per second for the rest of the challenge.
+struct RacingConfig {
+  bool enabled{false};
+  uint32 checkpoint_steps{30};
+  real max_speed{8.0};
+  double elite_fraction{0.2};  // Evolutor keeps the top fifth
+};
+
+// Successive halving: every creature runs up to the first rung, given as a
+// fraction of the full challenge, and only the best keep_fraction of them by
+// fitness so far go on to the next rung. The survivors of the last rung run
+// the full challenge. The challenges are paused at a rung and picked up again
+// from there, so no step is simulated twice.
+struct HalvingConfig {
+  bool enabled{false};
+  std::vector<double> rungs{0.2, 0.5};  // Increasing, below 1
+  double keep_fraction{0.5};
+};
+
+// Runs the challenge of every creature in a generation on a work-stealing
+// thread pool. Every creature slot keeps its own challenge, reset for the
+// creature in that slot each generation, so nothing is shared between threads
+// except the generation (read only) and one fitness slot per creature.
+//
+// By default a task runs a whole challenge. With set_steps_per_task(n) each
+// task only runs n steps and then queues the rest as a new task, which idle
+// workers can steal, so long challenges don't hold up the end of a batch.
+//
+// Challenges are deterministic, so fitness is memoized in a FitnessCache:
+// elites and repeated genomes are filled in from the cache when a generation
+// starts, and identical genomes within a generation are only simulated once.
+//
+// With racing on, a dropped creature gets the fitness it had reached, which is
+// below the cutoff. The cutoff only rises as more creatures finish, so as
+// long as max_speed really bounds the creatures, the elites (and so the next
+// generation) are the same as without racing. Only the fitness of the others
+// is lower and depends on the order the creatures finish in.
+//
+// With successive halving on, a creature dropped at a rung gets its fitness
+// at that rung, shifted down if needed so it ranks below every creature that
+// made it past the rung. That keeps the order of the top creatures, which is
+// all breeding looks at. Racing is not used while halving.
+//
+// With set_batch_size(n) a task simulates up to n creatures together instead:
+// in a PopulationWorld where it supports the config, otherwise in a
+// WalkingBatchChallenge as long as there are no random bodies for the
+// creatures to share. Both give the same fitness as a challenge each, so the
+// cache stays valid. Other configs, and runs with racing or halving, which
+// pause or drop single creatures, keep a challenge per creature.
+//
+// start() returns right away, so a render loop can keep drawing and poll
+// done(); evaluate() is the blocking version for headless runs.
+template <class ChallengeType>
+class GenerationEvaluator {
+ public:
+  explicit GenerationEvaluator(
+      float dt,
+      ChallengeConfig config = {},
+      uint32 thread_count = ThreadPool::default_thread_count());
+  ~GenerationEvaluator();
+
+  void start(const Generation& generation);
+  bool done() const;
+  // Number of creatures evaluated so far in this generation
+  uint32 completed() const { return m_completed.load(); }
+
+  // Blocks until the generation started last is done
+  const std::vector<double>& wait();
+  const std::vector<double>& evaluate(const Generation& generation);
+
+  // Only valid once done() returns true
+  const std::vector<double>& fitness() const { return m_fitness; }
+
+  uint32 thread_count() const { return m_pool.thread_count(); }
+
+  // 0 runs every challenge in a single task
+  void set_steps_per_task(uint32 steps) { m_steps_per_task = steps; }
+  // Creatures simulated together per task where possible, 0 for none
+  void set_batch_size(uint32 creatures) { m_batch_size = creatures; }
+
+  // Turn off for challenges that are not deterministic
+  void set_use_fitness_cache(bool use) { m_use_cache = use; }
+  FitnessCache& fitness_cache() { return m_cache; }
+
+  // Only change between generations, the workers read it
+  void set_racing(RacingConfig racing) { m_racing = racing; }
+  // Number of creatures dropped by racing in this generation
+  uint32 aborted() const { return m_aborted.load(); }
+  // Only change between generations, the workers read it
+  void set_halving(HalvingConfig halving) { m_halving = halving; }
+
+  // Steps simulated in this generation, over all creatures
+  uint64_t steps_simulated() const { return m_steps_simulated.load(); }
+
+  // Number of creatures simulated in this generation whose challenge ended
+  // for the given reason. Cached creatures are not counted.
+  uint32 terminated(Termination reason) const {
+    return m_terminated[static_cast<int>(reason)].load();
+  }
+
+  // Steal counts and utilization of the workers, for tuning
+  SchedulerStats scheduler_stats() const { return m_pool.stats(); }
+  void reset_scheduler_stats() { m_pool.reset_stats(); }
+
+ private:
+  void run_steps(uint32 index);
+  // Whether set_batch_size applies to the current settings
+  bool use_batches() const;
+  void run_batch(const std::vector<uint32>& creatures);
+  template <class Batch>
+  void run_batch(Batch& batch, const std::vector<uint32>& creatures);
+  bool is_hopeless(ChallengeType& challenge) const;
+  // Fills in the fitness of creature index and its duplicates
+  void finish(uint32 index, double fitness, bool complete);
+  void add_finished(double fitness, uint32 count);
+
+  // Called when a creature is paused at the current rung or done. The last
+  // one to get there picks the survivors and starts the next rung.
+  void leave_rung();
+  void start_rung(std::vector<uint32> creatures);
+  // Gives the dropped creatures their fitness, once the finalists are done
+  void finish_halving();
+
+  float m_dt;
+  ChallengeConfig m_config;
+  Generation m_generation{};
+  std::vector<double> m_fitness{};
+  std::vector<std::unique_ptr<ChallengeType>> m_challenges{};  // Per creature
+  uint32 m_steps_per_task{0};
+  uint32 m_batch_size{0};
+
+  FitnessCache m_cache{};
+  uint64_t m_fingerprint;
+  bool m_use_cache{true};
+  // Creatures with the same genome as creature i, which get its fitness
+  std::vector<std::vector<uint32>> m_duplicates{};
+
+  RacingConfig m_racing{};
+  uint32 m_elite_count{0};
+  std::mutex m_elite_mutex{};
+  std::vector<double> m_elite{};  // Min-heap of the best finished fitness
+  std::atomic<double> m_cutoff{0.0};
+  std::atomic<uint32> m_aborted{0};
+  std::array<std::atomic<uint32>, 4> m_terminated{};  // By Termination
+
+  HalvingConfig m_halving{};
+  struct Rung {
+    std::vector<uint32> creatures{};
+    std::vector<uint32> dropped{};  // Ranked from best to worst
+  };
+  std::vector<Rung> m_rungs{};
+  // Fraction of the challenge the current rung runs to
+  double m_rung_end{std::numeric_limits<double>::infinity()};
+  std::atomic<uint32> m_rung_pending{0};
+
+  std::atomic<uint64_t> m_steps_simulated{0};
+
+  std::atomic<uint32> m_completed{0};
+  std::atomic<bool> m_cancel{false};
+  ThreadPool m_pool;  // Declared last, so the workers are gone first
+};
+
+template <class ChallengeType>
+GenerationEvaluator<ChallengeType>::GenerationEvaluator(float dt,
+                                                        ChallengeConfig config,
+                                                        uint32 thread_count)
+    : m_dt{dt},
+      m_config{config},
+      m_fingerprint{fingerprint(config, dt)},
+      m_pool{thread_count} {}
+
+template <class ChallengeType>
+GenerationEvaluator<ChallengeType>::~GenerationEvaluator() {
+  m_cancel = true;
+  m_pool.wait_idle();
+}
+
+template <class ChallengeType>
+void GenerationEvaluator<ChallengeType>::start(const Generation& generation) {
+  m_pool.wait_idle();  // The workers read m_generation
+
+  m_generation = generation;
+  m_fitness.assign(generation.dna.size(), 0.0);
+  m_challenges.resize(generation.dna.size());
+  m_duplicates.assign(generation.dna.size(), {});
+  m_elite.clear();
+  m_elite_count = std::max<uint32>(
+      1, static_cast<uint32>(generation.dna.size() * m_racing.elite_fraction));
+  m_cutoff = -std::numeric_limits<double>::infinity();
+  m_aborted = 0;
+  for (std::atomic<uint32>& count : m_terminated) {
+    count = 0;
+  }
+  m_steps_simulated = 0;
+  m_rungs.clear();
+  m_rung_end = std::numeric_limits<double>::infinity();
+
+  std::vector<uint32> to_simulate{};
+  uint32 cached = 0;
+  std::unordered_map<uint64_t, uint32> first_with_hash{};
+  for (uint32 i = 0; i < generation.dna.size(); ++i) {
+    const CreatureDNA& dna = generation.dna[i];
+    if (m_use_cache) {
+      if (m_cache.lookup(dna, m_fingerprint, m_fitness[i])) {
+        add_finished(m_fitness[i], 1);
+        ++cached;
+        continue;
+      }
+      uint64_t key = FitnessCache::hash(dna, m_fingerprint);
+      auto first = first_with_hash.find(key);
+      if (first != first_with_hash.end() &&
+          std::memcmp(generation.dna[first->second].raw_dna, dna.raw_dna,
+                      sizeof(dna.raw_dna)) == 0) {
+        m_duplicates[first->second].push_back(i);
+        continue;
+      }
+      first_with_hash.emplace(key, i);
+    }
+    to_simulate.push_back(i);
+  }
+
+  m_completed = cached;
+  if (use_batches()) {
+    for (uint32 begin = 0; begin < to_simulate.size(); begin += m_batch_size) {
+      uint32 end = std::min(begin + m_batch_size,
+                            static_cast<uint32>(to_simulate.size()));
+      std::vector<uint32> creatures(to_simulate.begin() + begin,
+                                    to_simulate.begin() + end);
+      m_pool.submit([this, creatures](uint32) { run_batch(creatures); });
+    }
+    return;
+  }
+  if (m_halving.enabled && !to_simulate.empty()) {
+    m_rung_end = m_halving.rungs.empty() ? m_rung_end : m_halving.rungs[0];
+    m_rungs.push_back(Rung{to_simulate, {}});
+    m_rung_pending = static_cast<uint32>(to_simulate.size());
+  }
+  for (uint32 i : to_simulate) {
+    m_pool.submit([this, i](uint32) {
+      const CreatureDNA& dna = m_generation.dna[i];
+      if (m_challenges[i]) {
+        m_challenges[i]->reset(dna);
+      } else {
+        m_challenges[i] = std::make_unique<ChallengeType>(dna, m_config);
+      }
+      run_steps(i);
+    });
+  }
+}
+
+template <class ChallengeType>
+bool GenerationEvaluator<ChallengeType>::done() const {
+  // Acquire pairs with the release in finish, so the fitness
+  // values are visible once the count is complete
+  return m_completed.load(std::memory_order_acquire) ==
+         m_generation.dna.size();
+}
+
+template <class ChallengeType>
+const std::vector<double>& GenerationEvaluator<ChallengeType>::wait() {
+  m_pool.wait_idle();
+  assert(done());
+  return m_fitness;
+}
+
+template <class ChallengeType>
+const std::vector<double>& GenerationEvaluator<ChallengeType>::evaluate(
+    const Generation& generation) {
+  start(generation);
+  return wait();
+}
+
+template <class ChallengeType>
+void GenerationEvaluator<ChallengeType>::run_steps(uint32 index) {
+  ChallengeType& challenge = *m_challenges[index];
+  uint32 step = 0;
+  // Counted once per task rather than per step, to keep the atomic cold
+  struct StepCounter {
+    std::atomic<uint64_t>& total;
+    const uint32& steps;
+    ~StepCounter() { total.fetch_add(steps, std::memory_order_relaxed); }
+  } counter{m_steps_simulated, step};
+
+  for (; m_steps_per_task == 0 || step < m_steps_per_task; ++step) {
+    if (m_cancel.load(std::memory_order_relaxed)) {
+      return;
+    }
+    if (challenge.steps_done() >=
+        m_rung_end * (challenge.steps_done() + challenge.steps_left())) {
+      m_fitness[index] = challenge.partial_fitness();
+      leave_rung();
+      return;
+    }
+    if (challenge.step(m_dt)) {
+      ++step;
+      m_terminated[static_cast<int>(challenge.termination())].fetch_add(
+          1 + static_cast<uint32>(m_duplicates[index].size()));
+      finish(index, challenge.get_fitness(), true);
+      if (m_halving.enabled) {
+        leave_rung();
+      }
+      return;
+    }
+    if (m_racing.enabled && !m_halving.enabled &&
+        m_racing.checkpoint_steps > 0 &&
+        challenge.steps_done() % m_racing.checkpoint_steps == 0 &&
+        is_hopeless(challenge)) {
+      m_aborted.fetch_add(1 + static_cast<uint32>(m_duplicates[index].size()));
+      ++step;
+      finish(index, challenge.partial_fitness(), false);
+      return;
+    }
+  }
+  // Out of steps for this task, queue the rest
+  m_pool.submit([this, index](uint32) { run_steps(index); });
+}
+
+template <class ChallengeType>
+bool GenerationEvaluator<ChallengeType>::use_batches() const {
+  if (m_batch_size == 0 || m_racing.enabled || m_halving.enabled) {
+    return false;
+  }
+  using CreatureType = typename ChallengeType::CreatureType;
+  bool lockstep = std::is_same<CreatureType, RollingWheelCreature>::value &&
+                  PopulationWorld::supports(m_config);
+  return lockstep || m_config.nr_bodies == 0;
+}
+
+template <class ChallengeType>
+void GenerationEvaluator<ChallengeType>::run_batch(
+    const std::vector<uint32>& creatures) {
+  using CreatureType = typename ChallengeType::CreatureType;
+  std::vector<CreatureDNA> dna{};
+  for (uint32 i : creatures) {
+    dna.push_back(m_generation.dna[i]);
+  }
+  if (std::is_same<CreatureType, RollingWheelCreature>::value &&
+      PopulationWorld::supports(m_config)) {
+    PopulationWorld batch{dna, m_config};
+    run_batch(batch, creatures);
+  } else {
+    WalkingBatchChallenge<CreatureType> batch{dna, m_config};
+    run_batch(batch, creatures);
+  }
+}
+
+template <class ChallengeType>
+template <class Batch>
+void GenerationEvaluator<ChallengeType>::run_batch(
+    Batch& batch,
+    const std::vector<uint32>& creatures) {
+  uint64_t steps = 0;
+  do {
+    if (m_cancel.load(std::memory_order_relaxed)) {
+      return;
+    }
+    steps += batch.running();
+  } while (!batch.step(m_dt));
+  m_steps_simulated.fetch_add(steps, std::memory_order_relaxed);
+
+  for (uint32 i = 0; i < creatures.size(); ++i) {
+    uint32 index = creatures[i];
+    m_terminated[static_cast<int>(batch.termination(i))].fetch_add(
+        1 + static_cast<uint32>(m_duplicates[index].size()));
+    finish(index, batch.get_fitness(i), true);
+  }
+}
+
+template <class ChallengeType>
+bool GenerationEvaluator<ChallengeType>::is_hopeless(
+    ChallengeType& challenge) const {
+  double best_possible = challenge.partial_fitness() +
+                         m_racing.max_speed * m_dt * challenge.steps_left();
+  return best_possible < m_cutoff.load(std::memory_order_relaxed);
+}
+
+template <class ChallengeType>
+void GenerationEvaluator<ChallengeType>::finish(uint32 index,
+                                                double fitness,
+                                                bool complete) {
+  m_fitness[index] = fitness;
+  for (uint32 duplicate : m_duplicates[index]) {
+    m_fitness[duplicate] = fitness;
+  }
+  uint32 count = 1 + static_cast<uint32>(m_duplicates[index].size());
+  if (complete) {
+    if (m_use_cache) {
+      m_cache.insert(m_generation.dna[index], m_fingerprint, fitness);
+    }
+    add_finished(fitness, count);
+  }
+  m_completed.fetch_add(count, std::memory_order_release);
+}
+
+template <class ChallengeType>
+void GenerationEvaluator<ChallengeType>::add_finished(double fitness,
+                                                      uint32 count) {
+  if (!m_racing.enabled) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{m_elite_mutex};
+  for (uint32 i = 0; i < count; ++i) {
+    if (m_elite.size() < m_elite_count) {
+      m_elite.push_back(fitness);
+      std::push_heap(m_elite.begin(), m_elite.end(), std::greater<double>{});
+    } else if (fitness > m_elite.front()) {
+      std::pop_heap(m_elite.begin(), m_elite.end(), std::greater<double>{});
+      m_elite.back() = fitness;
+      std::push_heap(m_elite.begin(), m_elite.end(), std::greater<double>{});
+    }
+  }
+  if (m_elite.size() == m_elite_count) {
+    m_cutoff.store(m_elite.front(), std::memory_order_relaxed);
+  }
+}
+
+template <class ChallengeType>
+void GenerationEvaluator<ChallengeType>::leave_rung() {
+  if (m_rung_pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  if (m_cancel.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  // Everyone is paused or done, so this thread has the rung to itself
+  Rung& rung = m_rungs.back();
+  std::vector<uint32> running{};
+  for (uint32 i : rung.creatures) {
+    if (m_challenges[i]->termination() == Termination::running) {
+      running.push_back(i);
+    }
+  }
+  if (running.empty()) {
+    finish_halving();
+    return;
+  }
+
+  // Ties go to the lower index, so the cut doesn't depend on the threads
+  std::sort(running.begin(), running.end(), [this](uint32 a, uint32 b) {
+    return m_fitness[a] > m_fitness[b] ||
+           (m_fitness[a] == m_fitness[b] && a < b);
+  });
+  uint32 keep = std::max<uint32>(
+      1, static_cast<uint32>(running.size() * m_halving.keep_fraction));
+  keep = std::min(keep, static_cast<uint32>(running.size()));
+  rung.dropped.assign(running.begin() + keep, running.end());
+  running.resize(keep);
+
+  uint32 next = static_cast<uint32>(m_rungs.size());
+  m_rung_end = next < m_halving.rungs.size()
+                   ? m_halving.rungs[next]
+                   : std::numeric_limits<double>::infinity();
+  start_rung(std::move(running));
+}
+
+template <class ChallengeType>
+void GenerationEvaluator<ChallengeType>::start_rung(
+    std::vector<uint32> creatures) {
+  // Iterates the local copy, the last task of the rung can get to
+  // leave_rung and grow m_rungs before this loop is done
+  m_rung_pending = static_cast<uint32>(creatures.size());
+  m_rungs.push_back(Rung{creatures, {}});
+  for (uint32 i : creatures) {
+    m_pool.submit([this, i](uint32) { run_steps(i); });
+  }
+}
+
+template <class ChallengeType>
+void GenerationEvaluator<ChallengeType>::finish_halving() {
+  // Work back from the last rung, so the creatures that made it past a rung
+  // all have their final fitness when the ones dropped there are placed
+  for (uint32 r = static_cast<uint32>(m_rungs.size()) - 1; r-- > 0;) {
+    const std::vector<uint32>& dropped = m_rungs[r].dropped;
+    if (dropped.empty()) {
+      continue;
+    }
+    double lowest_kept = std::numeric_limits<double>::infinity();
+    for (uint32 i : m_rungs[r + 1].creatures) {
+      lowest_kept = std::min(lowest_kept, m_fitness[i]);
+    }
+    double below_kept =
+        std::nextafter(lowest_kept, -std::numeric_limits<double>::infinity());
+    double shift = std::max(0.0, m_fitness[dropped.front()] - below_kept);
+    for (uint32 i : dropped) {
+      finish(i, std::min(m_fitness[i] - shift, below_kept), false);
+    }
+  }
+}
+
+}  // namespace ev
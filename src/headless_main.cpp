@@ -0,0 +1,223 @@
+// Runs the evolution without a window or any OpenGL, as fast as the cores
+// allow. Meant for machines without a display.
+//
+// Usage: ev_headless [options]
+//   --generations N     Generations to run (default 100)
+//   --population N      Creatures per generation (default 100)
+//   --threads N         Worker threads (default: one per core)
+//   --steps-per-task N  Run challenges in tasks of N steps (default: whole)
+//   --batch N           Simulate N creatures together per task where the
+//                       challenge allows it, see GenerationEvaluator
+//   --seconds N         Length of each challenge (default 15)
+//   --terrain SEED      Walk on generated terrain instead of flat ground
+//   --solver N          Sequential impulse contact solver with N iterations
+//                       instead of the legacy one
+//   --seed N            Seed for everything random in the run (default 0)
+//   --race SPEED        Drop creatures that can't reach the elites even
+//                       moving SPEED units per second for the rest of the run
+//   --halving R1,R2,..  Successive halving: run everyone to the first rung (a
+//                       fraction of the challenge), keep the best half, etc.
+//   --best-dna FILE     Write the best DNA of the last generation to FILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include "creatures/rolling_wheel.h"
+#include "evolution.h"
+#include "generation_evaluator.h"
+#include "rng.h"
+#include "simulator.h"
+#include "utils.h"
+
+using namespace ev;
+using namespace std::chrono;
+
+namespace {
+
+using ChallengeType = WalkingChallenge<RollingWheelCreature>;
+
+// Same step length as the viewer, so fitness values are comparable
+constexpr float simulation_dt = 1.0f / 30.0f;
+
+struct Options {
+  int generations{100};
+  int population{100};
+  uint32 threads{ThreadPool::default_thread_count()};
+  uint32 steps_per_task{0};
+  uint32 batch_size{0};
+  uint64_t seed{0};
+  ChallengeConfig challenge{};
+  RacingConfig racing{};
+  HalvingConfig halving{};
+  std::string best_dna_path{};
+};
+
+void print_usage() {
+  std::cerr << "Usage: ev_headless [--generations N] [--population N] "
+               "[--threads N] [--steps-per-task N] [--batch N] [--seconds N] "
+               "[--terrain SEED] [--solver N] [--seed N] [--race SPEED] "
+               "[--halving R1,R2,..] [--best-dna FILE]"
+            << std::endl;
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (std::strcmp(arg, "--help") == 0) {
+      return false;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    const char* value = argv[++i];
+    if (std::strcmp(arg, "--generations") == 0) {
+      options.generations = std::atoi(value);
+    } else if (std::strcmp(arg, "--population") == 0) {
+      options.population = std::atoi(value);
+    } else if (std::strcmp(arg, "--threads") == 0) {
+      options.threads = static_cast<uint32>(std::atoi(value));
+    } else if (std::strcmp(arg, "--steps-per-task") == 0) {
+      options.steps_per_task = static_cast<uint32>(std::atoi(value));
+    } else if (std::strcmp(arg, "--batch") == 0) {
+      options.batch_size = static_cast<uint32>(std::atoi(value));
+    } else if (std::strcmp(arg, "--seconds") == 0) {
+      options.challenge.seconds = std::atoi(value);
+    } else if (std::strcmp(arg, "--terrain") == 0) {
+      options.challenge.ground = GroundType::terrain;
+      options.challenge.terrain_seed = std::strtoull(value, nullptr, 10);
+    } else if (std::strcmp(arg, "--solver") == 0) {
+      options.challenge.solver.type = phys::SolverType::sequential_impulse;
+      options.challenge.solver.iterations =
+          static_cast<uint32>(std::atoi(value));
+    } else if (std::strcmp(arg, "--seed") == 0) {
+      options.seed = std::strtoull(value, nullptr, 10);
+    } else if (std::strcmp(arg, "--race") == 0) {
+      options.racing.enabled = true;
+      options.racing.max_speed = std::atof(value);
+    } else if (std::strcmp(arg, "--halving") == 0) {
+      options.halving.enabled = true;
+      options.halving.rungs.clear();
+      for (char* end = nullptr;; ++value) {
+        options.halving.rungs.push_back(std::strtod(value, &end));
+        value = end;
+        if (*value != ',') {
+          break;
+        }
+      }
+    } else if (std::strcmp(arg, "--best-dna") == 0) {
+      options.best_dna_path = value;
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  // Breeding keeps the top fifth and picks parents from the top tenth
+  if (options.generations < 1 || options.population < 10 ||
+      options.threads < 1 || options.challenge.seconds < 1) {
+    std::cerr << "Need at least 1 generation, 10 creatures, 1 thread and "
+                 "1 second"
+              << std::endl;
+    return false;
+  }
+  double last_rung = 0.0;
+  for (double rung : options.halving.rungs) {
+    if (rung <= last_rung || rung >= 1.0) {
+      std::cerr << "Halving rungs must be increasing fractions below 1"
+                << std::endl;
+      return false;
+    }
+    last_rung = rung;
+  }
+  return true;
+}
+
+// One gene per line, at full precision so the DNA can be read back exactly
+bool write_dna(const std::string& path, const CreatureDNA& dna) {
+  std::ofstream file{path};
+  if (!file) {
+    return false;
+  }
+  file.precision(17);
+  for (real gene : dna.raw_dna) {
+    file << gene << '\n';
+  }
+  return static_cast<bool>(file);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options{};
+  if (!parse_options(argc, argv, options)) {
+    print_usage();
+    return 1;
+  }
+
+  // Separate streams for breeding and for the challenge setup, so changing
+  // one doesn't shift the random numbers of the other
+  Evolutor evolutor{Rng::stream(options.seed, 0).next()};
+  options.challenge.seed = Rng::stream(options.seed, 1).next();
+  GenerationEvaluator<ChallengeType> evaluator{
+      simulation_dt, options.challenge, options.threads};
+  evaluator.set_steps_per_task(options.steps_per_task);
+  evaluator.set_batch_size(options.batch_size);
+  evaluator.set_racing(options.racing);
+  evaluator.set_halving(options.halving);
+  Generation generation = evolutor.generate_fresh_generation(options.population);
+  CreatureDNA best_dna{};
+  double best_fitness = 0.0;
+
+  std::printf("%10s %12s %12s %12s %10s %6s %8s %8s %8s %8s %8s %10s\n",
+              "generation", "best", "mean", "worst", "ms", "util", "steals",
+              "cached", "aborted", "at rest", "exploded", "steps");
+  for (int i = 0; i < options.generations; ++i) {
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    evaluator.reset_scheduler_stats();
+    evaluator.fitness_cache().reset_stats();
+    std::vector<double> fitness = evaluator.evaluate(generation);
+    SchedulerStats stats = evaluator.scheduler_stats();
+    double ms = duration_cast<microseconds>(high_resolution_clock::now() -
+                                            start)
+                    .count() /
+                1000.0;
+
+    int best = max_element_index(fitness);
+    best_dna = generation.dna[best];
+    best_fitness = fitness[best];
+    double mean =
+        std::accumulate(fitness.begin(), fitness.end(), 0.0) / fitness.size();
+    double worst = *std::min_element(fitness.begin(), fitness.end());
+    std::printf(
+        "%10d %12.4f %12.4f %12.4f %10.1f %6.2f %8llu %8llu %8u %8u %8u "
+        "%10llu\n",
+        generation.generation_nr, best_fitness, mean, worst, ms,
+        stats.utilization, static_cast<unsigned long long>(stats.steals),
+        static_cast<unsigned long long>(evaluator.fitness_cache().hits()),
+        evaluator.aborted(), evaluator.terminated(Termination::at_rest),
+        evaluator.terminated(Termination::exploded),
+        static_cast<unsigned long long>(evaluator.steps_simulated()));
+    std::fflush(stdout);
+
+    if (i + 1 < options.generations) {
+      generation = evolutor.breed_next_generation(generation, fitness,
+                                                  options.population);
+    }
+  }
+
+  if (!options.best_dna_path.empty()) {
+    if (!write_dna(options.best_dna_path, best_dna)) {
+      std::cerr << "Could not write " << options.best_dna_path << std::endl;
+      return 1;
+    }
+    std::cout << "Best DNA (fitness " << best_fitness << ") written to "
+              << options.best_dna_path << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,38 @@
+#include "manifold.h"
+#include <algorithm>
+#include <utility>
+
+namespace ev {
+namespace phys {
+
+void ManifoldStore::begin_step() {
+  std::swap(m_manifolds, m_last_step);
+  m_manifolds.clear();
+  m_manifolds.reserve(m_last_step.size());
+  m_pair_begin = 0;
+  m_pair_end = 0;
+}
+
+void ManifoldStore::reset() {
+  m_manifolds.clear();
+  m_last_step.clear();
+}
+
+void ManifoldStore::remove_bodies(const std::vector<uint32>& new_index) {
+  // The bodies keep their order, and so do the pairs
+  uint32 kept = 0;
+  for (const Manifold& manifold : m_manifolds) {
+    uint32 body_a = new_index[manifold.body_a];
+    uint32 body_b = new_index[manifold.body_b];
+    if (body_a != removed_body && body_b != removed_body) {
+      m_manifolds[kept] = manifold;
+      m_manifolds[kept].body_a = body_a;
+      m_manifolds[kept].body_b = body_b;
+      ++kept;
+    }
+  }
+  m_manifolds.resize(kept);
+}
+
+}  // end namespace phys
+}  // end namespace ev
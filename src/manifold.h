@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include "broadphase.h"
+#include "collision.h"
+#include "common.h"
+
+namespace ev {
+namespace phys {
+
+// The impulses a contact point ended a step with, for warm starting
+struct ContactImpulse {
+  uint32 feature;  // See CollisionData::feature_ids
+  real normal_impulse;
+  real tangent_impulse;
+};
+
+// What is remembered about two shapes of a broadphase pair from one step to
+// the next. The bodies are indices into World::objects(), body_a < body_b as
+// in BroadphasePair, and the shapes are shape ids (see CollisionData) on
+// body_a and body_b.
+struct Manifold {
+  uint32 body_a;
+  uint32 body_b;
+  uint32 shape_a;
+  uint32 shape_b;
+  SeparatingAxis axis{};
+  ContactImpulse contacts[2]{};
+  int contact_count{0};
+};
+
+// Keeps a Manifold for every shape pair the narrowphase tests, as long as the
+// broadphase keeps reporting their bodies as a pair. Every step starts a new
+// list and carries over the manifolds of the pairs tested again, the others
+// expire. The pairs come in the sorted order of Broadphase::pairs(), so
+// finding the manifolds of the last step is a merge rather than a search.
+class ManifoldStore {
+ public:
+  // Moves the current manifolds to the last step
+  void begin_step();
+  // Call for every broadphase pair, in order, before its shape pairs
+  void inline begin_pair(uint32 body_a, uint32 body_b);
+  // Index of the manifold of two shapes of the current pair, a copy of the
+  // one from the last step if there was one
+  uint32 inline find_or_add(uint32 shape_a, uint32 shape_b);
+
+  // The shape pairs tested this step, in the order they were tested
+  std::vector<Manifold>& manifolds() { return m_manifolds; }
+  const std::vector<Manifold>& manifolds() const { return m_manifolds; }
+  void set_manifolds(const std::vector<Manifold>& manifolds) {
+    m_manifolds = manifolds;
+  }
+
+  void reset();
+  // Drops the manifolds of removed bodies and renumbers the others, as in
+  // Broadphase::remove_bodies
+  void remove_bodies(const std::vector<uint32>& new_index);
+
+ private:
+  std::vector<Manifold> m_manifolds{};
+  std::vector<Manifold> m_last_step{};
+  // The manifolds of the current pair in m_last_step
+  uint32 m_pair_begin{0};
+  uint32 m_pair_end{0};
+  uint32 m_body_a{0};
+  uint32 m_body_b{0};
+};
+
+// Inline, they run for every shape pair the narrowphase tests
+
+void ManifoldStore::begin_pair(uint32 body_a, uint32 body_b) {
+  m_body_a = body_a;
+  m_body_b = body_b;
+  m_pair_begin = m_pair_end;
+  while (m_pair_begin < m_last_step.size() &&
+         (m_last_step[m_pair_begin].body_a < body_a ||
+          (m_last_step[m_pair_begin].body_a == body_a &&
+           m_last_step[m_pair_begin].body_b < body_b))) {
+    ++m_pair_begin;
+  }
+  m_pair_end = m_pair_begin;
+  while (m_pair_end < m_last_step.size() &&
+         m_last_step[m_pair_end].body_a == body_a &&
+         m_last_step[m_pair_end].body_b == body_b) {
+    ++m_pair_end;
+  }
+}
+
+uint32 ManifoldStore::find_or_add(uint32 shape_a, uint32 shape_b) {
+  uint32 index = static_cast<uint32>(m_manifolds.size());
+  // Bodies have a handful of shapes, so a scan of the pair is enough
+  for (uint32 i = m_pair_begin; i < m_pair_end; ++i) {
+    const Manifold& manifold = m_last_step[i];
+    if (manifold.shape_a == shape_a && manifold.shape_b == shape_b) {
+      m_manifolds.push_back(manifold);
+      return index;
+    }
+  }
+  m_manifolds.push_back(Manifold{m_body_a, m_body_b, shape_a, shape_b});
+  return index;
+}
+
+}  // end namespace phys
+}  // end namespace ev
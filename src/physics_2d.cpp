@@ -1,27 +1,81 @@
 #include "physics_2d.h"
 #include <math.h>
+#include <algorithm>
+#include <cassert>
 #include <cstdlib>
 #include <iostream>
 #include "collision.h"
 #include "common.h"
 #include "ev_math.h"
+#include "rng.h"
 #include "shapes.h"
 
 namespace ev {
 namespace phys {
 // unsigned int fp_control_state = _controlfp(_EM_INEXACT, _MCW_EM);
 
+World::World(BroadphaseType broadphase, SolverConfig solver)
+    : m_solver{solver} {
+  set_broadphase(broadphase);
+}
+
+void World::set_broadphase(BroadphaseType broadphase) {
+  m_broadphase = make_broadphase(broadphase);
+}
+
 void World::add(Body* object) {
   m_objects.push_back(object);
 }
-void World::add_random_bodies(uint32_t nr) {
+
+void World::remove(Body* object) {
+  auto it = std::find(m_objects.begin(), m_objects.end(), object);
+  assert(it != m_objects.end());
+  uint32 index = static_cast<uint32>(it - m_objects.begin());
+  m_new_index.resize(m_objects.size());
+  for (uint32 i = 0; i < m_objects.size(); ++i) {
+    m_new_index[i] = i < index ? i : i - 1;
+  }
+  m_new_index[index] = removed_body;
+  compact();
+}
+
+void World::remove(const std::vector<Body*>& objects) {
+  m_removed.assign(objects.begin(), objects.end());
+  std::sort(m_removed.begin(), m_removed.end());
+  m_new_index.resize(m_objects.size());
+  uint32 kept = 0;
+  for (uint32 i = 0; i < m_objects.size(); ++i) {
+    bool removed =
+        std::binary_search(m_removed.begin(), m_removed.end(), m_objects[i]);
+    m_new_index[i] = removed ? removed_body : kept++;
+  }
+  assert(m_objects.size() - kept == m_removed.size());
+  compact();
+}
+
+void World::compact() {
+  uint32 kept = 0;
+  for (uint32 i = 0; i < m_objects.size(); ++i) {
+    if (m_new_index[i] != removed_body) {
+      m_objects[kept++] = m_objects[i];
+    }
+  }
+  m_objects.resize(kept);
+  m_manifolds.remove_bodies(m_new_index);
+  m_broadphase->remove_bodies(m_new_index);
+}
+
+void World::add_random_bodies(uint32_t nr, uint64_t seed) {
+  Rng rng{seed};
   for (uint32_t i = 0; i < nr; i++) {
     std::unique_ptr<Body> object = std::make_unique<Body>();
-    object->add_polygon(
-        Polygon{real(rand() % 5) + 1.0f, real(rand() % 5) + 1.0f});
-    object->m_pos = Vec2{static_cast<real>(rand() % 100 - 50),
-                         static_cast<real>(rand() % 100) + 10};
-    object->m_orientation = static_cast<real>((rand() % 100) / 50.0 - 1.0f);
+    real half_width = real(rng.below(5)) + 1.0f;
+    real half_height = real(rng.below(5)) + 1.0f;
+    object->add_polygon(Polygon{half_width, half_height});
+    real x = static_cast<real>(rng.below(100)) - 50.0f;
+    real y = static_cast<real>(rng.below(100)) + 10.0f;
+    object->m_pos = Vec2{x, y};
+    object->m_orientation = Rot{rng.below(100) / 50.0 - 1.0};
     object->restitution = 0.1f;
     m_objects.push_back(object.get());
     m_owned_objects.push_back(std::move(object));
@@ -30,59 +84,233 @@ void World::add_random_bodies(uint32_t nr) {
 
 void World::reset() {
   m_objects.clear();
+  m_owned_objects.clear();
+  m_broadphase->reset();
+  m_manifolds.reset();
+  m_kinetic_energy = 0.0f;
+  m_finite = true;
+}
+
+void World::save(WorldSnapshot& snapshot) const {
+  snapshot.bodies.resize(m_objects.size());
+  size_t shape_count = 0;
+  for (const Body* obj : m_objects) {
+    shape_count += obj->m_polygons.size() + obj->m_circles.size();
+  }
+  snapshot.shapes.resize(shape_count);
+
+  ShapeState* shape = snapshot.shapes.data();
+  for (size_t i = 0; i < m_objects.size(); ++i) {
+    const Body& obj = *m_objects[i];
+    snapshot.bodies[i] = obj.state();
+    for (const Polygon& polygon : obj.m_polygons) {
+      *shape++ = ShapeState{polygon.m_pos, polygon.m_velocity};
+    }
+    for (const Circle& circle : obj.m_circles) {
+      *shape++ = ShapeState{circle.m_pos, circle.m_velocity};
+    }
+  }
+  snapshot.manifolds = m_manifolds.manifolds();
+  snapshot.kinetic_energy = m_kinetic_energy;
+  snapshot.finite = m_finite;
+}
+
+void World::restore(const WorldSnapshot& snapshot) {
+  assert(snapshot.bodies.size() == m_objects.size());
+  const ShapeState* shape = snapshot.shapes.data();
+  for (size_t i = 0; i < m_objects.size(); ++i) {
+    Body& obj = *m_objects[i];
+    obj.set_state(snapshot.bodies[i]);
+    for (Polygon& polygon : obj.m_polygons) {
+      polygon.m_pos = shape->pos;
+      polygon.m_velocity = shape->velocity;
+      ++shape;
+    }
+    for (Circle& circle : obj.m_circles) {
+      circle.m_pos = shape->pos;
+      circle.m_velocity = shape->velocity;
+      ++shape;
+    }
+    obj.update_world_cache();
+  }
+  assert(shape == snapshot.shapes.data() + snapshot.shapes.size());
+  m_manifolds.set_manifolds(snapshot.manifolds);
+  m_kinetic_energy = snapshot.kinetic_energy;
+  m_finite = snapshot.finite;
 }
 
 void World::step(float dt) {
+  m_frame_arena.reset();
+
   for (Body* obj : m_objects) {
     obj->step(dt);
+    obj->update_world_cache();
+  }
+  CollisionList collisions{ArenaAllocator<CollisionData>{m_frame_arena}};
+
+  m_broadphase->update(m_objects);
+  // The broadphase already dropped the pairs should_collide() filters out
+  m_manifolds.begin_step();
+  for (const BroadphasePair& pair : m_broadphase->pairs()) {
+    m_manifolds.begin_pair(pair.a, pair.b);
+    collide(pair.a, pair.b, collisions);
+  }
+
+  m_solver.solve(collisions, m_manifolds.manifolds(), m_objects, dt,
+                 m_frame_arena);
+
+  m_kinetic_energy = 0.0f;
+  m_finite = true;
+  for (const Body* obj : m_objects) {
+    m_kinetic_energy += obj->kinetic_energy();
+    m_finite = m_finite && obj->is_finite();
+  }
+}
+
+namespace {
+
+// First shape id of each kind of shape on a body, see CollisionData
+uint32 first_circle_id(const Body& body) {
+  return static_cast<uint32>(body.m_polygons.size());
+}
+uint32 first_plane_id(const Body& body) {
+  return first_circle_id(body) + static_cast<uint32>(body.m_circles.size());
+}
+uint32 first_heightfield_id(const Body& body) {
+  return first_plane_id(body) + static_cast<uint32>(body.m_planes.size());
+}
+
+}  // namespace
+
+uint32 World::manifold(uint32 body,
+                       uint32 shape,
+                       uint32 other_body,
+                       uint32 other_shape) {
+  // Manifolds are named in the order of the broadphase pair
+  return body < other_body ? m_manifolds.find_or_add(shape, other_shape)
+                           : m_manifolds.find_or_add(other_shape, shape);
+}
+
+void World::record(bool touching,
+                   CollisionData& collision_data,
+                   uint32 manifold,
+                   CollisionList& collisions) {
+  if (touching) {
+    collision_data.manifold = manifold;
+    collisions.push_back(std::move(collision_data));
+  } else {
+    m_manifolds.manifolds()[manifold].contact_count = 0;
+  }
+}
+
+void World::collide(uint32 a, uint32 b, CollisionList& collisions) {
+  Body& obj_a = *m_objects[a];
+  Body& obj_b = *m_objects[b];
+  uint32 circles_a = first_circle_id(obj_a);
+  uint32 circles_b = first_circle_id(obj_b);
+
+  for (uint32 i = 0; i < obj_a.m_circles.size(); ++i) {
+    for (uint32 j = 0; j < obj_b.m_circles.size(); ++j) {
+      Circle& circle_a = obj_a.m_circles[i];
+      Circle& circle_b = obj_b.m_circles[j];
+      CollisionData collision_data{obj_a, obj_b, circle_a, circle_b};
+      uint32 index = manifold(a, circles_a + i, b, circles_b + j);
+      record(circle_vs_circle(circle_a, circle_b, collision_data),
+             collision_data, index, collisions);
+    }
+  }
+
+  for (uint32 i = 0; i < obj_a.m_polygons.size(); ++i) {
+    for (uint32 j = 0; j < obj_b.m_polygons.size(); ++j) {
+      Polygon& poly_a = obj_a.m_polygons[i];
+      Polygon& poly_b = obj_b.m_polygons[j];
+      CollisionData collision_data{obj_a, obj_b, poly_a, poly_b};
+      uint32 index = manifold(a, i, b, j);
+      SeparatingAxis& axis = m_manifolds.manifolds()[index].axis;
+      record(polygon_vs_polygon(poly_a, poly_b, collision_data, &axis),
+             collision_data, index, collisions);
+    }
+  }
+
+  for (uint32 i = 0; i < obj_a.m_polygons.size(); ++i) {
+    for (uint32 j = 0; j < obj_b.m_circles.size(); ++j) {
+      Polygon& polygon = obj_a.m_polygons[i];
+      Circle& circle = obj_b.m_circles[j];
+      CollisionData collision_data{obj_a, obj_b, polygon, circle};
+      uint32 index = manifold(a, i, b, circles_b + j);
+      record(polygon_vs_circle(polygon, circle, collision_data),
+             collision_data, index, collisions);
+    }
   }
-  std::vector<CollisionData> collisions{};
-
-  for (unsigned int i = 0; i < m_objects.size(); i++) {
-    Body* obj_a = m_objects.at(i);
-    for (unsigned int j = i + 1; j < m_objects.size(); j++) {
-      Body* obj_b = m_objects.at(j);
-
-      for (Circle& circle_a : obj_a->m_circles) {
-        for (Circle& circle_b : obj_b->m_circles) {
-          CollisionData collision_data{*obj_a, *obj_b, circle_a, circle_b};
-          if (circle_vs_circle(circle_a, circle_b, collision_data)) {
-            collisions.push_back(std::move(collision_data));
-          }
-        }
-      }
-
-      for (Polygon& poly_a : obj_a->m_polygons) {
-        for (Polygon& poly_b : obj_b->m_polygons) {
-          CollisionData collision_data{*obj_a, *obj_b, poly_a, poly_b};
-          if (polygon_vs_polygon(poly_a, poly_b, collision_data)) {
-            collisions.push_back(std::move(collision_data));
-          }
-        }
-      }
-
-      for (Polygon& polygon : obj_a->m_polygons) {
-        for (Circle& circle : obj_b->m_circles) {
-          CollisionData collision_data{*obj_a, *obj_b, polygon, circle};
-          if (polygon_vs_circle(polygon, circle, collision_data)) {
-            collisions.push_back(std::move(collision_data));
-          }
-        }
-      }
-
-      for (Circle& circle : obj_a->m_circles) {
-        for (Polygon& polygon : obj_b->m_polygons) {
-          CollisionData collision_data{*obj_b, *obj_a, circle, polygon};
-          if (polygon_vs_circle(polygon, circle, collision_data)) {
-            collisions.push_back(std::move(collision_data));
-          }
-        }
-      }
+
+  for (uint32 i = 0; i < obj_a.m_circles.size(); ++i) {
+    for (uint32 j = 0; j < obj_b.m_polygons.size(); ++j) {
+      Circle& circle = obj_a.m_circles[i];
+      Polygon& polygon = obj_b.m_polygons[j];
+      CollisionData collision_data{obj_b, obj_a, circle, polygon};
+      uint32 index = manifold(a, circles_a + i, b, j);
+      record(polygon_vs_circle(polygon, circle, collision_data),
+             collision_data, index, collisions);
+    }
+  }
+
+  // Ground shapes are always shape a, so the normal points away from them.
+  // Most bodies have none, which is worth checking up front with all pairs.
+  if (!obj_a.m_planes.empty() || !obj_a.m_heightfields.empty()) {
+    collide_ground(a, b, collisions);
+  }
+  if (!obj_b.m_planes.empty() || !obj_b.m_heightfields.empty()) {
+    collide_ground(b, a, collisions);
+  }
+}
+
+void World::collide_ground(uint32 ground_index,
+                           uint32 other_index,
+                           CollisionList& collisions) {
+  Body& ground = *m_objects[ground_index];
+  Body& other = *m_objects[other_index];
+  uint32 planes = first_plane_id(ground);
+  uint32 heightfields = first_heightfield_id(ground);
+  uint32 circles = first_circle_id(other);
+
+  for (uint32 i = 0; i < ground.m_planes.size(); ++i) {
+    Plane& plane = ground.m_planes[i];
+    for (uint32 j = 0; j < other.m_polygons.size(); ++j) {
+      Polygon& polygon = other.m_polygons[j];
+      CollisionData collision_data{ground, other, plane, polygon};
+      uint32 index = manifold(ground_index, planes + i, other_index, j);
+      record(plane_vs_polygon(plane, polygon, collision_data), collision_data,
+             index, collisions);
+    }
+
+    for (uint32 j = 0; j < other.m_circles.size(); ++j) {
+      Circle& circle = other.m_circles[j];
+      CollisionData collision_data{ground, other, plane, circle};
+      uint32 index =
+          manifold(ground_index, planes + i, other_index, circles + j);
+      record(plane_vs_circle(plane, circle, collision_data), collision_data,
+             index, collisions);
     }
   }
 
-  for (CollisionData collision : collisions) {
-    resolve_collision(collision);
+  for (uint32 i = 0; i < ground.m_heightfields.size(); ++i) {
+    Heightfield& heightfield = ground.m_heightfields[i];
+    for (uint32 j = 0; j < other.m_polygons.size(); ++j) {
+      Polygon& polygon = other.m_polygons[j];
+      CollisionData collision_data{ground, other, heightfield, polygon};
+      uint32 index = manifold(ground_index, heightfields + i, other_index, j);
+      record(heightfield_vs_polygon(heightfield, polygon, collision_data),
+             collision_data, index, collisions);
+    }
+
+    for (uint32 j = 0; j < other.m_circles.size(); ++j) {
+      Circle& circle = other.m_circles[j];
+      CollisionData collision_data{ground, other, heightfield, circle};
+      uint32 index =
+          manifold(ground_index, heightfields + i, other_index, circles + j);
+      record(heightfield_vs_circle(heightfield, circle, collision_data),
+             collision_data, index, collisions);
+    }
   }
 }
 
@@ -90,5 +318,13 @@ std::vector<Body*>& World::objects() {
   return m_objects;
 }
 
+void World::query(const AABB& aabb, std::vector<Body*>& result) const {
+  m_query_result.clear();
+  m_broadphase->query(aabb, m_query_result);
+  for (uint32 index : m_query_result) {
+    result.push_back(m_objects[index]);
+  }
+}
+
 }  // end namespace phys
 }  // namespace ev
@@ -1,23 +1,102 @@
 #pragma once
 #include <memory>
 #include <vector>
+#include "broadphase.h"
+#include "collision.h"
 #include "common.h"
-#include "renderer_opengl.h"
+#include "contact_solver.h"
+#include "frame_arena.h"
+#include "manifold.h"
 namespace ev {
 namespace phys {
 
+// The state of every body in a world, in two flat arrays. Static shapes
+// (planes, heightfields) never change and are left out.
+struct WorldSnapshot {
+  std::vector<BodyState> bodies{};
+  std::vector<ShapeState> shapes{};  // Polygons, then circles, body by body
+  std::vector<Manifold> manifolds{};
+  real kinetic_energy{0.0f};
+  bool finite{true};
+};
+
 class World {
  public:
+  World(BroadphaseType broadphase = BroadphaseType::sweep_and_prune,
+        SolverConfig solver = {});
+  void set_broadphase(BroadphaseType broadphase);
+  void set_solver(const SolverConfig& solver) { m_solver.set_config(solver); }
+  const SolverConfig& solver() const { return m_solver.config(); }
+  // Lets the sequential impulse solver spread big contact sets over pool.
+  // The results stay the same for any thread count.
+  void set_thread_pool(ThreadPool* pool) { m_solver.set_thread_pool(pool); }
   void add(Body* object);
-  void add_random_bodies(uint32_t nr);
+  // Takes a body back out, the others keep their order. Only for bodies that
+  // were add()ed, the world doesn't own those.
+  void remove(Body* object);
+  // remove() for several bodies at once, in one pass over the world
+  void remove(const std::vector<Body*>& objects);
+  // Drops nr random boxes into the world, the same ones for the same seed
+  void add_random_bodies(uint32_t nr, uint64_t seed);
   void step(float dt);
   void reset();
   std::vector<Body*>& objects();
 
+  // Appends all bodies whose bounds overlap aabb, as of the last step
+  void query(const AABB& aabb, std::vector<Body*>& result) const;
+
+  // Total kinetic energy of the bodies after the last step, and whether they
+  // all still have finite state. Lets challenges spot blown up simulations.
+  real kinetic_energy() const { return m_kinetic_energy; }
+  bool is_finite() const { return m_finite; }
+
+  // Copies the body state into snapshot, reusing its storage, so saving into
+  // the same snapshot again doesn't allocate
+  void save(WorldSnapshot& snapshot) const;
+  // Puts the bodies back the way they were at save(). The world must hold the
+  // same bodies as then, like a world built from the same challenge setup.
+  void restore(const WorldSnapshot& snapshot);
+
+  // Scratch memory for the current step, reset at the start of every step
+  const FrameArena& frame_arena() const { return m_frame_arena; }
+  // The shape pairs the narrowphase tested in the last step
+  const std::vector<Manifold>& manifolds() const {
+    return m_manifolds.manifolds();
+  }
+
  private:
+  // Runs the narrowphase on every shape pair of the bodies at index a and b
+  void collide(uint32 a, uint32 b, CollisionList& collisions);
+  // Collides the planes and heightfields of the ground body with the shapes
+  // of the other one
+  void collide_ground(uint32 ground, uint32 other, CollisionList& collisions);
+  // Index of the manifold of shape on body and other_shape on other_body
+  uint32 manifold(uint32 body,
+                  uint32 shape,
+                  uint32 other_body,
+                  uint32 other_shape);
+  // Takes out the bodies m_new_index marks as removed
+  void compact();
+  // Keeps the collision if the shapes are touching, otherwise clears the
+  // contacts of their manifold
+  void record(bool touching,
+              CollisionData& collision_data,
+              uint32 manifold,
+              CollisionList& collisions);
+
+  std::unique_ptr<Broadphase> m_broadphase{};
+  ManifoldStore m_manifolds{};
+  ContactSolver m_solver;
+  mutable std::vector<uint32> m_query_result{};
+  // Where remove() moves every body, see Broadphase::remove_bodies
+  std::vector<uint32> m_new_index{};
+  std::vector<Body*> m_removed{};  // Sorted copy of the bodies to remove
+  FrameArena m_frame_arena{};
   std::vector<std::unique_ptr<Body>> m_owned_objects{};
   std::vector<Body*> m_objects{};
   std::vector<std::unique_ptr<Body>> m_tmp_body_storage{};
+  real m_kinetic_energy{0.0f};
+  bool m_finite{true};
 };
 
 }  // end namespace phys
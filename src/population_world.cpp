@@ -0,0 +1,551 @@
+#include "population_world.h"
+#include <cassert>
+#include <cmath>
+
+namespace ev {
+
+// The loops below mirror Body::step, RollingWheelCreature::step,
+// plane_vs_polygon and resolve_collision expression for expression, float
+// literals included, so keep them in sync with those.
+//
+// The loops over creatures are marked omp simd, which with -fopenmp-simd only
+// tells the compiler the lanes are independent and doesn't need the OpenMP
+// runtime. CMakeLists.txt sets that flag for this file, together with the
+// ones that let it if-convert the math (no errno, no FP traps). Neither
+// changes any result.
+
+PopulationWorld::PopulationWorld(const std::vector<CreatureDNA>& dna,
+                                 ChallengeConfig config)
+    : m_size{static_cast<uint32>(dna.size())},
+      m_config{config},
+      m_iterations_to_complete{60 * config.seconds},
+      m_running{m_size} {
+  assert(supports(config));
+
+  m_ground.update_world_cache();
+  const Plane& plane = m_ground.m_planes[0];
+  m_plane_normal = plane.world_normal();
+  m_plane_offset = -plane.distance(Vec2{0.0f, 0.0f});
+
+  auto per_creature = [this](std::vector<real>& lanes) {
+    lanes.assign(m_size, 0.0f);
+  };
+  auto per_leg = [this](std::vector<real>& lanes) {
+    lanes.assign(legs * m_size, 0.0f);
+  };
+  for (std::vector<real>* lanes :
+       {&m_time, &m_pos_x, &m_pos_y, &m_vel_x, &m_vel_y, &m_rot_c, &m_rot_s,
+        &m_angular_velocity, &m_torque, &m_angular_mass, &m_angular_mass_inv,
+        &m_rest_x, &m_rest_time, &m_fitness, &m_com_x, &m_com_y,
+        &m_new_rot_c, &m_new_rot_s, &m_delta_angle}) {
+    per_creature(*lanes);
+  }
+  for (std::vector<real>* lanes :
+       {&m_amplitude, &m_freq, &m_phase, &m_leg_x, &m_leg_y, &m_leg_vel_x,
+        &m_leg_vel_y, &m_contact_count, &m_contact0_x, &m_contact0_y,
+        &m_contact1_x, &m_contact1_y, &m_penetration}) {
+    per_leg(*lanes);
+  }
+  m_termination.assign(m_size, Termination::running);
+
+  // Take the starting state from real creatures, so it is bit for bit what
+  // WalkingChallenge starts from
+  for (uint32 i = 0; i < m_size; ++i) {
+    RollingWheelCreature creature{dna[i]};
+    Body& body = creature.body();
+    BodyState state = body.state();
+    if (i == 0) {
+      m_restitution = fmin(m_ground.restitution, body.restitution);
+      m_mass = state.mass;
+      m_mass_inv = body.mass_inv();
+      m_shape_angular_mass = state.shape_angular_mass;
+      for (uint32 leg = 0; leg < legs; ++leg) {
+        const Polygon& polygon = body.m_polygons[leg];
+        assert(polygon.vertex_count() == 4);
+        m_leg_area[leg] = polygon.mass(1.0);
+        m_leg_rotation[leg] = polygon.rotation();
+        for (uint32 v = 0; v < 4; ++v) {
+          m_leg_vertex[leg][v] = polygon.vertex(v);
+        }
+      }
+    }
+    m_time[i] = creature.state().time;
+    m_pos_x[i] = state.pos.x;
+    m_pos_y[i] = state.pos.y;
+    m_vel_x[i] = state.velocity.x;
+    m_vel_y[i] = state.velocity.y;
+    m_rot_c[i] = state.orientation.c;
+    m_rot_s[i] = state.orientation.s;
+    m_angular_velocity[i] = state.angular_velocity;
+    m_torque[i] = state.torque;
+    m_angular_mass[i] = state.angular_mass;
+    m_angular_mass_inv[i] = body.angular_mass_inv();
+    m_rest_x[i] = state.pos.x;
+    for (uint32 leg = 0; leg < legs; ++leg) {
+      uint32 j = leg * m_size + i;
+      m_amplitude[j] = creature.m_amplitudes[leg];
+      m_freq[j] = creature.m_freqs[leg];
+      m_phase[j] = creature.m_phase[leg];
+      m_leg_x[j] = body.m_polygons[leg].m_pos.x;
+      m_leg_y[j] = body.m_polygons[leg].m_pos.y;
+      m_leg_vel_x[j] = body.m_polygons[leg].m_velocity.x;
+      m_leg_vel_y[j] = body.m_polygons[leg].m_velocity.y;
+    }
+  }
+}
+
+bool PopulationWorld::supports(const ChallengeConfig& config) {
+  return config.ground == GroundType::flat && config.nr_bodies == 0 &&
+         config.solver.type == phys::SolverType::legacy;
+}
+
+bool PopulationWorld::step(float dt) {
+  if (m_num_iterations == m_iterations_to_complete) {
+    return true;
+  }
+  // Creatures that are done keep being stepped along with the others, which
+  // is cheaper than compacting the lanes. Their fitness is already saved.
+  actuate(dt);
+  integrate(dt);
+  find_contacts();
+  for (uint32 leg = 0; leg < legs; ++leg) {
+    resolve_contacts(leg);
+  }
+  ++m_num_iterations;
+  return check_termination(dt);
+}
+
+// RollingWheelCreature::step and Body::update_mass_distribution
+void PopulationWorld::actuate(real dt) {
+  const uint32 n = m_size;
+  real* time = m_time.data();
+#pragma omp simd
+  for (uint32 i = 0; i < n; ++i) {
+    time[i] += dt;
+  }
+  for (uint32 leg = 0; leg < legs; ++leg) {
+    Vec2 dir = m_leg_rotation[leg].x_axis();
+    real* vel_x = &m_leg_vel_x[leg * n];
+    real* vel_y = &m_leg_vel_y[leg * n];
+    const real* amplitude = &m_amplitude[leg * n];
+    const real* freq = &m_freq[leg * n];
+    const real* phase = &m_phase[leg * n];
+    // The only loop with a call in it, libm's cos doesn't vectorize
+    for (uint32 i = 0; i < n; ++i) {
+      real wave = cos(freq[i] * time[i] + phase[i]);
+      vel_x[i] = wave * (freq[i] * (amplitude[i] * dir.x));
+      vel_y[i] = wave * (freq[i] * (amplitude[i] * dir.y));
+    }
+  }
+
+  real* pos_x = m_pos_x.data();
+  real* pos_y = m_pos_y.data();
+  real* leg_x = m_leg_x.data();
+  real* leg_y = m_leg_y.data();
+  real* angular_mass = m_angular_mass.data();
+  real* angular_mass_inv = m_angular_mass_inv.data();
+  const real* rot_c = m_rot_c.data();
+  const real* rot_s = m_rot_s.data();
+  real* com_x = m_com_x.data();
+  real* com_y = m_com_y.data();
+  const real mass = m_mass;
+  const real mass_inv = m_mass_inv;
+
+  // Sums over the legs, one leg at a time so every load is contiguous.
+  // angular_mass holds the angular mass around the body origin until the end.
+#pragma omp simd
+  for (uint32 i = 0; i < n; ++i) {
+    com_x[i] = 0.0;
+    com_y[i] = 0.0;
+    angular_mass[i] = m_shape_angular_mass;
+  }
+  for (uint32 leg = 0; leg < legs; ++leg) {
+    const real area = m_leg_area[leg];
+    const real* x = &leg_x[leg * n];
+    const real* y = &leg_y[leg * n];
+#pragma omp simd
+    for (uint32 i = 0; i < n; ++i) {
+      com_x[i] += area * x[i];
+      com_y[i] += area * y[i];
+      angular_mass[i] += area * (x[i] * x[i] + y[i] * y[i]);
+    }
+  }
+
+#pragma omp simd
+  for (uint32 i = 0; i < n; ++i) {
+    com_x[i] *= mass_inv;
+    com_y[i] *= mass_inv;
+    pos_x[i] += rot_c[i] * com_x[i] - rot_s[i] * com_y[i];
+    pos_y[i] += rot_s[i] * com_x[i] + rot_c[i] * com_y[i];
+    angular_mass[i] -= mass * (com_x[i] * com_x[i] + com_y[i] * com_y[i]);
+    angular_mass_inv[i] = 1.0f / angular_mass[i];
+  }
+  for (uint32 leg = 0; leg < legs; ++leg) {
+    real* x = &leg_x[leg * n];
+    real* y = &leg_y[leg * n];
+#pragma omp simd
+    for (uint32 i = 0; i < n; ++i) {
+      x[i] -= com_x[i];
+      y[i] -= com_y[i];
+    }
+  }
+  // The guard against a zero angular mass gets its own loop, so the division
+  // doesn't end up behind a branch
+#pragma omp simd
+  for (uint32 i = 0; i < n; ++i) {
+    angular_mass_inv[i] =
+        fabs(angular_mass[i]) > 0.00001f ? angular_mass_inv[i] : 0.0f;
+  }
+}
+
+// Body::step of the creature, the ground doesn't move
+void PopulationWorld::integrate(real dt) {
+  const uint32 n = m_size;
+  real* pos_x = m_pos_x.data();
+  real* pos_y = m_pos_y.data();
+  real* vel_x = m_vel_x.data();
+  real* vel_y = m_vel_y.data();
+  real* rot_c = m_rot_c.data();
+  real* rot_s = m_rot_s.data();
+  real* angular_velocity = m_angular_velocity.data();
+  real* delta_angle = m_delta_angle.data();
+  const real* torque = m_torque.data();
+  const real* angular_mass_inv = m_angular_mass_inv.data();
+
+  real* new_rot_c = m_new_rot_c.data();
+  real* new_rot_s = m_new_rot_s.data();
+
+#pragma omp simd
+  for (uint32 i = 0; i < n; ++i) {
+    pos_x[i] += dt * vel_x[i];
+    pos_y[i] += dt * vel_y[i];
+
+    // The Taylor series path of Rot::integrate, for every creature. Writing
+    // it out to scratch instead of selecting keeps the compiler from turning
+    // the select back into a branch around the sqrt, which doesn't vectorize.
+    real d = angular_velocity[i] * dt;
+    real d2 = d * d;
+    real dc = 1.0f - d2 / 90.0f;
+    dc = 1.0f - d2 / 56.0f * dc;
+    dc = 1.0f - d2 / 30.0f * dc;
+    dc = 1.0f - d2 / 12.0f * dc;
+    dc = 1.0f - d2 / 2.0f * dc;
+    real ds = 1.0f - d2 / 110.0f;
+    ds = 1.0f - d2 / 72.0f * ds;
+    ds = 1.0f - d2 / 42.0f * ds;
+    ds = 1.0f - d2 / 20.0f * ds;
+    ds = d * (1.0f - d2 / 6.0f * ds);
+    real c = rot_c[i];
+    real s = rot_s[i];
+    real new_c = c * dc - s * ds;
+    real new_s = s * dc + c * ds;
+    real len_inv = 1.0f / sqrt(new_c * new_c + new_s * new_s);
+    new_rot_c[i] = new_c * len_inv;
+    new_rot_s[i] = new_s * len_inv;
+    delta_angle[i] = d;
+
+    vel_x[i] += dt * 0.0f;  // Gravity
+    vel_y[i] += dt * -9.0f;
+    angular_velocity[i] += torque[i] * angular_mass_inv[i] * dt;
+  }
+
+  // Rot::integrate takes the exact path for more than 0.25 rad in one step,
+  // which only wildly spinning creatures get to
+  for (uint32 i = 0; i < n; ++i) {
+    if (fabs(delta_angle[i]) > 0.25f) {
+      Rot rotation =
+          Rot::from_cos_sin(rot_c[i], rot_s[i]) * Rot{delta_angle[i]};
+      new_rot_c[i] = rotation.c;
+      new_rot_s[i] = rotation.s;
+    }
+  }
+  m_rot_c.swap(m_new_rot_c);
+  m_rot_s.swap(m_new_rot_s);
+
+  real* leg_x = m_leg_x.data();
+  real* leg_y = m_leg_y.data();
+  const real* leg_vel_x = m_leg_vel_x.data();
+  const real* leg_vel_y = m_leg_vel_y.data();
+#pragma omp simd
+  for (uint32 j = 0; j < legs * n; ++j) {
+    leg_x[j] += dt * leg_vel_x[j];
+    leg_y[j] += dt * leg_vel_y[j];
+  }
+}
+
+// plane_vs_polygon for every leg, on world vertices computed like
+// Polygon::update_world_cache
+void PopulationWorld::find_contacts() {
+  const uint32 n = m_size;
+  const Vec2 normal = m_plane_normal;
+  const real offset = m_plane_offset;
+  const real* pos_x = m_pos_x.data();
+  const real* pos_y = m_pos_y.data();
+  const real* rot_c = m_rot_c.data();
+  const real* rot_s = m_rot_s.data();
+
+  for (uint32 leg = 0; leg < legs; ++leg) {
+    const Rot leg_rotation = m_leg_rotation[leg];
+    const Vec2* vertices = m_leg_vertex[leg];
+    const real* leg_x = &m_leg_x[leg * n];
+    const real* leg_y = &m_leg_y[leg * n];
+    real* contact_count = &m_contact_count[leg * n];
+    real* contact0_x = &m_contact0_x[leg * n];
+    real* contact0_y = &m_contact0_y[leg * n];
+    real* contact1_x = &m_contact1_x[leg * n];
+    real* contact1_y = &m_contact1_y[leg * n];
+    real* penetration = &m_penetration[leg * n];
+
+#pragma omp simd
+    for (uint32 i = 0; i < n; ++i) {
+      real c = rot_c[i];
+      real s = rot_s[i];
+      real center_x = pos_x[i] + (c * leg_x[i] - s * leg_y[i]);
+      real center_y = pos_y[i] + (s * leg_x[i] + c * leg_y[i]);
+      real world_c = c * leg_rotation.c - s * leg_rotation.s;
+      real world_s = s * leg_rotation.c + c * leg_rotation.s;
+
+      auto vertex = [&](uint32 v, real& x, real& y, real& distance) {
+        x = center_x + (world_c * vertices[v].x - world_s * vertices[v].y);
+        y = center_y + (world_s * vertices[v].x + world_c * vertices[v].y);
+        distance = (normal.x * x + normal.y * y) - offset;
+      };
+
+      // Keep the two deepest vertices, with the same comparisons. The scalar
+      // path starts both out at infinity, which picks the same two vertices
+      // for the first pair as the one comparison here as long as the
+      // distances are finite. Lanes that aren't have exploded anyway.
+      real x0, y0, separation0;
+      real x1, y1, separation1;
+      vertex(0, x0, y0, separation0);
+      vertex(1, x1, y1, separation1);
+      bool swap = separation1 < separation0;
+      real swap_x = x0;
+      real swap_y = y0;
+      real swap_separation = separation0;
+      x0 = swap ? x1 : x0;
+      y0 = swap ? y1 : y0;
+      separation0 = swap ? separation1 : separation0;
+      x1 = swap ? swap_x : x1;
+      y1 = swap ? swap_y : y1;
+      separation1 = swap ? swap_separation : separation1;
+      // Written out for the last two vertices, like the contact points in
+      // resolve_contacts
+      auto insert = [&](uint32 v) {
+        real x, y, distance;
+        vertex(v, x, y, distance);
+        // Plain selects without && or nesting, which the vectorizer's
+        // if-conversion gives up on
+        bool deepest = distance < separation0;
+        bool second = !deepest & (distance < separation1);
+        x1 = second ? x : x1;
+        y1 = second ? y : y1;
+        separation1 = second ? distance : separation1;
+        x1 = deepest ? x0 : x1;
+        y1 = deepest ? y0 : y1;
+        separation1 = deepest ? separation0 : separation1;
+        x0 = deepest ? x : x0;
+        y0 = deepest ? y : y0;
+        separation0 = deepest ? distance : separation0;
+      };
+      insert(2);
+      insert(3);
+
+      bool hit = !(separation0 >= 0.0f);
+      bool two = separation1 <= 0.1f;
+      // Both sides of a select are computed up front, arithmetic inside one
+      // might trap and keeps the select a branch
+      real mean_penetration = (-separation0 - separation1) / 2.0f;
+      real deepest_penetration = -separation0;
+      contact_count[i] = hit ? (two ? 2.0f : 1.0f) : 0.0f;
+      contact0_x[i] = x0;
+      contact0_y[i] = y0;
+      contact1_x[i] = x1;
+      contact1_y[i] = y1;
+      penetration[i] = two ? mean_penetration : deepest_penetration;
+    }
+  }
+}
+
+// resolve_collision with the ground as body a, for one leg of every creature
+void PopulationWorld::resolve_contacts(uint32 leg) {
+  const uint32 n = m_size;
+  const Vec2 normal = m_plane_normal;
+  const Vec2 a_pos = m_ground.m_pos;
+  const Vec2 shape_a_vel = m_ground.m_planes[0].m_velocity;
+  const Vec2 a_vel = m_ground.m_velocity + shape_a_vel;
+  const real a_ang_vel = m_ground.m_angular_velocity;
+  const real a_mass_inv = m_ground.mass_inv();
+  const real a_angular_mass_inv = m_ground.angular_mass_inv();
+  const real b_mass_inv = m_mass_inv;
+  const real restitution = m_restitution;
+
+  real* pos_x = m_pos_x.data();
+  real* pos_y = m_pos_y.data();
+  real* vel_x = m_vel_x.data();
+  real* vel_y = m_vel_y.data();
+  real* angular_velocity = m_angular_velocity.data();
+  const real* angular_mass_inv = m_angular_mass_inv.data();
+  const real* contact_count = &m_contact_count[leg * n];
+  const real* contact0_x = &m_contact0_x[leg * n];
+  const real* contact0_y = &m_contact0_y[leg * n];
+  const real* contact1_x = &m_contact1_x[leg * n];
+  const real* contact1_y = &m_contact1_y[leg * n];
+  const real* penetration = &m_penetration[leg * n];
+
+#pragma omp simd
+  for (uint32 i = 0; i < n; ++i) {
+    real count = contact_count[i];
+    // Cleared when the contact points move apart, which skips the rest of
+    // the collision including the position correction
+    bool active = count > 0.0f;
+
+    // Snapshot, both contact points work from the same state
+    real b_pos_x = pos_x[i];
+    real b_pos_y = pos_y[i];
+    real b_vel_x = vel_x[i] + shape_a_vel.x;
+    real b_vel_y = vel_y[i] + shape_a_vel.y;
+    real b_ang_vel = angular_velocity[i];
+    real b_angular_mass_inv = angular_mass_inv[i];
+
+    // The state the impulses are applied to, stored once at the end so there
+    // are no conditional stores
+    real velocity_x = vel_x[i];
+    real velocity_y = vel_y[i];
+    real ang_vel = angular_velocity[i];
+
+    // One contact point, written out twice below as the vectorizer doesn't
+    // unroll a loop inside the loop over creatures
+    auto resolve_point = [&](uint32 k, real contact_x, real contact_y) {
+
+      real a_r_x = contact_x - a_pos.x;
+      real a_r_y = contact_y - a_pos.y;
+      real b_r_x = contact_x - b_pos_x;
+      real b_r_y = contact_y - b_pos_y;
+
+      real rel_x =
+          ((b_vel_x + -b_ang_vel * b_r_y) - a_vel.x) - -a_ang_vel * a_r_y;
+      real rel_y =
+          ((b_vel_y + b_ang_vel * b_r_x) - a_vel.y) - a_ang_vel * a_r_x;
+      real contact_velocity = rel_x * normal.x + rel_y * normal.y;
+      bool separating = contact_velocity > 0;
+      bool contact = active & (k < count) & !separating;
+      active = active & !((k < count) & separating);
+
+      real a_cross_normal_sqr = a_r_x * normal.y - a_r_y * normal.x;
+      a_cross_normal_sqr *= a_cross_normal_sqr;
+      real b_cross_normal_sqr = b_r_x * normal.y - b_r_y * normal.x;
+      b_cross_normal_sqr *= b_cross_normal_sqr;
+      real impedance_sum_inv = a_mass_inv + b_mass_inv +
+                               a_cross_normal_sqr * a_angular_mass_inv +
+                               b_cross_normal_sqr * b_angular_mass_inv;
+
+      bool resting = (rel_x * rel_x + rel_y * rel_y) < 0.17f;
+      real impulse_magnitude =
+          -(1 + (resting ? 0.0f : restitution)) * contact_velocity;
+      impulse_magnitude /= impedance_sum_inv;
+      impulse_magnitude /= count;
+      real impulse_x = impulse_magnitude * normal.x;
+      real impulse_y = impulse_magnitude * normal.y;
+
+      real new_vel_x = velocity_x + b_mass_inv * impulse_x;
+      real new_vel_y = velocity_y + b_mass_inv * impulse_y;
+      real new_ang_vel =
+          ang_vel +
+          b_angular_mass_inv * (b_r_x * impulse_y - b_r_y * impulse_x);
+
+      // Friction, Vec2::normalize and the Coulomb check
+      real tangent_x = rel_x - contact_velocity * normal.x;
+      real tangent_y = rel_y - contact_velocity * normal.y;
+      real len = sqrt(tangent_x * tangent_x + tangent_y * tangent_y);
+      real len_inv = 1.0f / len;
+      real unit_x = tangent_x * len_inv;
+      real unit_y = tangent_y * len_inv;
+      tangent_x = len == 0.0 ? 0.0f : unit_x;
+      tangent_y = len == 0.0 ? 0.0f : unit_y;
+
+      real friction_impulse_mag = -(rel_x * tangent_x + rel_y * tangent_y);
+      friction_impulse_mag /= impedance_sum_inv;
+      friction_impulse_mag /= count;
+      bool friction = fabs(friction_impulse_mag) > 0.0000001f;
+      bool sticking = fabs(friction_impulse_mag) < 0.8f * impulse_magnitude;
+      real sticking_x = friction_impulse_mag * tangent_x;
+      real sticking_y = friction_impulse_mag * tangent_y;
+      real sliding_x = 0.7f * (-impulse_magnitude * tangent_x);
+      real sliding_y = 0.7f * (-impulse_magnitude * tangent_y);
+      real friction_x = sticking ? sticking_x : sliding_x;
+      real friction_y = sticking ? sticking_y : sliding_y;
+      real friction_vel_x = new_vel_x + b_mass_inv * friction_x;
+      real friction_vel_y = new_vel_y + b_mass_inv * friction_y;
+      real friction_ang_vel =
+          new_ang_vel +
+          b_angular_mass_inv * (b_r_x * friction_y - b_r_y * friction_x);
+
+      new_vel_x = friction ? friction_vel_x : new_vel_x;
+      new_vel_y = friction ? friction_vel_y : new_vel_y;
+      new_ang_vel = friction ? friction_ang_vel : new_ang_vel;
+      velocity_x = contact ? new_vel_x : velocity_x;
+      velocity_y = contact ? new_vel_y : velocity_y;
+      ang_vel = contact ? new_ang_vel : ang_vel;
+    };
+    resolve_point(0, contact0_x[i], contact0_y[i]);
+    resolve_point(1, contact1_x[i], contact1_y[i]);
+
+    // Avoid sinking. fmax written out, so the loop vectorizes.
+    real sinking = penetration[i] - 0.01f;
+    real correction_scale =
+        (sinking > 0.0f ? sinking : 0.0f) / (a_mass_inv + b_mass_inv);
+    real correction_x = correction_scale * (0.6f * normal.x);
+    real correction_y = correction_scale * (0.6f * normal.y);
+    real corrected_x = b_pos_x + b_mass_inv * correction_x;
+    real corrected_y = b_pos_y + b_mass_inv * correction_y;
+    pos_x[i] = active ? corrected_x : b_pos_x;
+    pos_y[i] = active ? corrected_y : b_pos_y;
+    vel_x[i] = velocity_x;
+    vel_y[i] = velocity_y;
+    angular_velocity[i] = ang_vel;
+  }
+}
+
+// The World monitors and WalkingChallenge::step's checks
+bool PopulationWorld::check_termination(real dt) {
+  const uint32 n = m_size;
+  m_running = 0;
+  for (uint32 i = 0; i < n; ++i) {
+    if (m_termination[i] != Termination::running) {
+      continue;
+    }
+    real x = m_pos_x[i];
+    real kinetic_energy =
+        0.5f * (m_mass * (m_vel_x[i] * m_vel_x[i] + m_vel_y[i] * m_vel_y[i]) +
+                m_angular_mass[i] * m_angular_velocity[i] *
+                    m_angular_velocity[i]);
+    bool finite = std::isfinite(m_pos_x[i]) && std::isfinite(m_pos_y[i]) &&
+                  std::isfinite(m_vel_x[i]) && std::isfinite(m_vel_y[i]) &&
+                  std::isfinite(m_rot_c[i]) && std::isfinite(m_rot_s[i]) &&
+                  std::isfinite(m_angular_velocity[i]);
+    if (!finite || !(kinetic_energy <= m_config.max_kinetic_energy)) {
+      m_termination[i] = Termination::exploded;
+      m_fitness[i] = m_config.exploded_fitness;
+    } else if (m_num_iterations == m_iterations_to_complete) {
+      m_termination[i] = Termination::completed;
+      m_fitness[i] = x;
+    } else if (fabs(x - m_rest_x[i]) > m_config.rest_distance) {
+      m_rest_x[i] = x;
+      m_rest_time[i] = 0.0f;
+    } else if (m_config.rest_seconds > 0.0f) {
+      m_rest_time[i] += dt;
+      if (m_rest_time[i] >= m_config.rest_seconds) {
+        m_termination[i] = Termination::at_rest;
+        m_fitness[i] = x;
+      }
+    }
+    m_running += m_termination[i] == Termination::running ? 1 : 0;
+  }
+  if (m_running == 0) {
+    m_num_iterations = m_iterations_to_complete;
+  }
+  return m_running == 0;
+}
+
+}  // namespace ev
@@ -0,0 +1,113 @@
+#pragma once
+#include <vector>
+#include "common.h"
+#include "creatures/rolling_wheel.h"
+#include "simulator.h"
+
+namespace ev {
+
+// Runs the WalkingChallenge of a whole population of RollingWheelCreatures in
+// lockstep. They all have the same topology, one body with the same box legs,
+// so instead of a World of Body objects per creature the state is kept as
+// structure of arrays with the creature as the inner index. Every stage of a
+// step is a loop over creatures written for the vectorizer, straight line
+// code with selects instead of branches, so with -O3 it turns into SIMD code
+// working on 2, 4 or 8 creatures at once depending on the target. The cos of
+// the leg actuation is the only scalar part.
+//
+// Only the flat ground challenge without random bodies, with the legacy
+// contact solver, is supported, see supports(). The creature touches nothing
+// but the plane there, so a world step comes down to integrating, finding the
+// plane contacts of every leg and resolving them one leg at a time. The
+// arithmetic is done in the same order as the scalar path, so the fitness
+// matches WalkingChallenge exactly unless the compiler contracts the math into
+// fused multiply-adds differently in the two (-ffp-contract, -march with FMA).
+class PopulationWorld {
+ public:
+  PopulationWorld(const std::vector<CreatureDNA>& dna,
+                  ChallengeConfig config = {});
+
+  static bool supports(const ChallengeConfig& config);
+
+  // Steps every creature that is still running. Returns true once all of them
+  // are done.
+  bool step(float dt);
+
+  uint32 size() const { return m_size; }
+  // Only call once the creature is done
+  real get_fitness(uint32 creature) const { return m_fitness[creature]; }
+  Termination termination(uint32 creature) const {
+    return m_termination[creature];
+  }
+  uint32 running() const { return m_running; }
+
+ private:
+  static constexpr uint32 legs = RollingWheelCreature::m_legs;
+
+  // The stages of a step, in the order WalkingChallenge runs them
+  void actuate(real dt);
+  void integrate(real dt);
+  void find_contacts();
+  void resolve_contacts(uint32 leg);
+  bool check_termination(real dt);
+
+  uint32 m_size;
+  ChallengeConfig m_config;
+  int m_num_iterations{0};
+  int m_iterations_to_complete;
+  uint32 m_running;
+
+  // The same for every creature
+  Body m_ground{{0.0f, 0.0f}, Plane{{0.0f, 1.0f}}};
+  Vec2 m_plane_normal{};
+  real m_plane_offset{};
+  real m_restitution{};
+  real m_mass{};
+  real m_mass_inv{};
+  real m_shape_angular_mass{};
+  real m_leg_area[legs]{};
+  Rot m_leg_rotation[legs]{};
+  Vec2 m_leg_vertex[legs][4]{};
+
+  // Per creature, indexed [creature]
+  std::vector<real> m_time{};
+  std::vector<real> m_pos_x{};
+  std::vector<real> m_pos_y{};
+  std::vector<real> m_vel_x{};
+  std::vector<real> m_vel_y{};
+  std::vector<real> m_rot_c{};
+  std::vector<real> m_rot_s{};
+  std::vector<real> m_angular_velocity{};
+  std::vector<real> m_torque{};
+  std::vector<real> m_angular_mass{};
+  std::vector<real> m_angular_mass_inv{};
+  std::vector<real> m_rest_x{};
+  std::vector<real> m_rest_time{};
+  std::vector<real> m_fitness{};
+  std::vector<Termination> m_termination{};
+  // Scratch for actuate and integrate
+  std::vector<real> m_com_x{};
+  std::vector<real> m_com_y{};
+  std::vector<real> m_new_rot_c{};
+  std::vector<real> m_new_rot_s{};
+  std::vector<real> m_delta_angle{};
+
+  // Per leg and creature, indexed [leg * m_size + creature]
+  std::vector<real> m_amplitude{};
+  std::vector<real> m_freq{};
+  std::vector<real> m_phase{};
+  std::vector<real> m_leg_x{};
+  std::vector<real> m_leg_y{};
+  std::vector<real> m_leg_vel_x{};
+  std::vector<real> m_leg_vel_y{};
+
+  // Plane contacts from find_contacts, indexed like the legs
+  std::vector<real> m_contact_count{};  // 0, 1 or 2
+  std::vector<real> m_contact0_x{};
+  std::vector<real> m_contact0_y{};
+  std::vector<real> m_contact1_x{};
+  std::vector<real> m_contact1_y{};
+  std::vector<real> m_penetration{};
+};
+
+}  // namespace ev
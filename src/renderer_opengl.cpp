@@ -203,28 +203,29 @@ GLuint OpenGLRenderer::setup_quad() {
 
   return vao;
 }
+// Translation * rotation * scale, built straight from the cos/sin of the
+// rotation instead of going through glm::rotate
+glm::mat4 model_matrix(Vec2 pos, const Rot& rotation, Vec2 scale) {
+  auto model_to_world = glm::mat4{1.0};
+  model_to_world[0] = glm::vec4{rotation.c * scale.x, rotation.s * scale.x,
+                                0.0f, 0.0f};
+  model_to_world[1] = glm::vec4{-rotation.s * scale.y, rotation.c * scale.y,
+                                0.0f, 0.0f};
+  model_to_world[3] = glm::vec4{pos.x, pos.y, 0.0f, 1.0f};
+  return model_to_world;
+}
+
 void OpenGLRenderer::draw_polygon(const Polygon& polygon,
                                   Vec2 body_pos,
-                                  float rotation) {
+                                  const Rot& rotation) {
   // Temporarily just draw a rectangle instead
-  Vec2 extent =
-      polygon.vertex(0) - polygon.vertex(polygon.m_vertices.size() / 2);
+  Vec2 extent = polygon.vertex(0) - polygon.vertex(polygon.vertex_count() / 2);
   extent.abs();
   extent = extent / 2.0f;
-  Vec2 pos = polygon.m_pos;
+  Vec2 pos = body_pos + rotation.rotate(polygon.m_pos);
 
-  auto model_to_world = glm::mat4{1.0};
-  model_to_world =
-      glm::translate(model_to_world, glm::vec3{body_pos.x, body_pos.y, 0.0f});
-  model_to_world =
-      glm::rotate(model_to_world, rotation, glm::vec3{0.0f, 0.0f, 1.0f});
-  model_to_world =
-      glm::translate(model_to_world, glm::vec3{pos.x, pos.y, 0.0f});
-  model_to_world =
-      glm::rotate(model_to_world, static_cast<float>(polygon.rotation()),
-                  glm::vec3{0.0f, 0.0f, 1.0f});
-  model_to_world =
-      glm::scale(model_to_world, glm::vec3{extent.x, extent.y, 1.0f});
+  auto model_to_world =
+      model_matrix(pos, rotation * polygon.rotation(), extent);
 
   auto transform = m_projection_matrix * m_view_matrix * model_to_world;
 
@@ -244,20 +245,63 @@ void OpenGLRenderer::draw_polygon(const Polygon& polygon,
   GL(glUseProgram(0));
 }
 
-void OpenGLRenderer::draw_circle(Circle circle, Vec2 body_pos, float rotation) {
+void OpenGLRenderer::draw_plane(const Plane& plane,
+                                Vec2 body_pos,
+                                const Rot& rotation) {
+  // Planes are infinite, draw a wide slab below the surface instead
+  const Vec2 extent{5000.0f, 50.0f};
+  Vec2 normal = rotation.rotate(plane.m_normal);
+  Vec2 pos = body_pos + rotation.rotate(plane.m_pos) - extent.y * normal;
+
+  // The quad's y axis along the normal
+  auto model_to_world =
+      model_matrix(pos, Rot::from_cos_sin(normal.y, -normal.x), extent);
+
+  auto transform = m_projection_matrix * m_view_matrix * model_to_world;
+
+  GL(glUseProgram(m_flat_shader_program));
+  GL(glBindVertexArray(m_quad_vao));
+  GL(glUniformMatrix4fv(m_flat_transform_loc, 1, GL_FALSE,
+                        glm::value_ptr(transform)));
+  GL(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
+  GL(glBindVertexArray(0));
+  GL(glUseProgram(0));
+}
+
+void OpenGLRenderer::draw_heightfield(const Heightfield& heightfield) {
+  // One thin quad hanging under each segment
+  constexpr real thickness = 0.25f;
+
+  GL(glUseProgram(m_flat_shader_program));
+  GL(glBindVertexArray(m_quad_vao));
+  for (uint32 i = 0; i + 1 < heightfield.sample_count(); ++i) {
+    Vec2 start = heightfield.world_point(i);
+    Vec2 segment = heightfield.world_point(i + 1) - start;
+    Vec2 normal = heightfield.segment_normal(i);
+    Vec2 pos = start + 0.5f * segment - thickness * normal;
+    Vec2 extent{0.5f * sqrt(squared_length(segment)), thickness};
+
+    auto model_to_world =
+        model_matrix(pos, Rot::from_cos_sin(normal.y, -normal.x), extent);
+    auto transform = m_projection_matrix * m_view_matrix * model_to_world;
+    GL(glUniformMatrix4fv(m_flat_transform_loc, 1, GL_FALSE,
+                          glm::value_ptr(transform)));
+    GL(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
+  }
+  GL(glBindVertexArray(0));
+  GL(glUseProgram(0));
+}
+
+void OpenGLRenderer::draw_circle(const Circle& circle,
+                                 Vec2 body_pos,
+                                 const Rot& rotation) {
   /* A lot of this code should be split into init
    * and tear-down code. But for now this makes
    * for easier reading even if it duplicates work*/
 
-  auto model_to_world = glm::mat4{1.0};
-  model_to_world =
-      glm::translate(model_to_world, glm::vec3{body_pos.x, body_pos.y, 0.0f});
-  model_to_world =
-      glm::rotate(model_to_world, rotation, glm::vec3{0.0f, 0.0f, 1.0f});
-  model_to_world = glm::translate(
-      model_to_world, glm::vec3{circle.m_pos.x, circle.m_pos.y, 0.0f});
-  model_to_world =
-      glm::scale(model_to_world, glm::vec3{circle.radius, circle.radius, 1.0f});
+  Vec2 pos = body_pos + rotation.rotate(circle.m_pos);
+  auto model_to_world =
+      model_matrix(pos, rotation, Vec2{circle.radius, circle.radius});
 
   auto transform = m_projection_matrix * m_view_matrix * model_to_world;
 
@@ -316,12 +360,20 @@ void OpenGLRenderer::draw_circle(Circle circle, Vec2 body_pos, float rotation) {
 }*/
 
 void OpenGLRenderer::draw_body(const Body& body) {
-  for (Polygon polygon : body.m_polygons) {
-    draw_polygon(polygon, body.m_pos, static_cast<float>(body.m_orientation));
+  for (const Polygon& polygon : body.m_polygons) {
+    draw_polygon(polygon, body.m_pos, body.m_orientation);
+  }
+
+  for (const Circle& circle : body.m_circles) {
+    draw_circle(circle, body.m_pos, body.m_orientation);
+  }
+
+  for (const Plane& plane : body.m_planes) {
+    draw_plane(plane, body.m_pos, body.m_orientation);
   }
 
-  for (const Circle circle : body.m_circles) {
-    draw_circle(circle, body.m_pos, static_cast<float>(body.m_orientation));
+  for (const Heightfield& heightfield : body.m_heightfields) {
+    draw_heightfield(heightfield);
   }
 }
 }  // namespace ev
@@ -20,8 +20,10 @@ class OpenGLRenderer {
   void start_frame();
   void end_frame();
   void draw_body(const Body& body);
-  void draw_circle(Circle circle, Vec2 offset, float rotation);
-  void draw_polygon(const Polygon& polygon, Vec2 offset, float rotation);
+  void draw_circle(const Circle& circle, Vec2 offset, const Rot& rotation);
+  void draw_polygon(const Polygon& polygon, Vec2 offset, const Rot& rotation);
+  void draw_plane(const Plane& plane, Vec2 offset, const Rot& rotation);
+  void draw_heightfield(const Heightfield& heightfield);
 
   void scroll_callback(GLFWwindow* window, float offset);
 
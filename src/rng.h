@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include "ev_math.h"
+
+namespace ev {
+
+// xoshiro256** (Blackman and Vigna): fast, small state, and good enough
+// statistically for everything stochastic in the simulation and evolution.
+// Every component owns its own Rng, seeded from the run seed, so results do
+// not depend on thread timing like a shared global generator would.
+class Rng {
+ public:
+  explicit Rng(uint64_t seed = 0) {
+    // splitmix64 spreads the seed over the whole state, and never leaves it
+    // all zeros, which xoshiro can't get out of
+    for (uint64_t& word : m_state) {
+      seed += 0x9e3779b97f4a7c15ull;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      word = z ^ (z >> 31);
+    }
+  }
+
+  // The index'th of a set of non-overlapping streams from the same seed, for
+  // handing out to parallel users
+  static Rng stream(uint64_t seed, uint32_t index) {
+    Rng rng{seed};
+    for (uint32_t i = 0; i < index; ++i) {
+      rng.jump();
+    }
+    return rng;
+  }
+
+  uint64_t next() {
+    uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+    uint64_t t = m_state[1] << 17;
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+    m_state[2] ^= t;
+    m_state[3] = rotl(m_state[3], 45);
+    return result;
+  }
+
+  // Uniform in [0, 1), from the top 53 bits
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+  real uniform(real min, real max) { return min + (max - min) * uniform(); }
+
+  // Uniform integer in [0, n). Multiply-shift instead of modulo, the bias is
+  // at most n / 2^32.
+  uint32_t below(uint32_t n) {
+    return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+  }
+
+  // Advances the state by 2^128 steps
+  void jump() {
+    constexpr uint64_t jump_polynomial[] = {
+        0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull,
+        0x39abdc4529b1661cull};
+    uint64_t state[4] = {0, 0, 0, 0};
+    for (uint64_t word : jump_polynomial) {
+      for (int bit = 0; bit < 64; ++bit) {
+        if (word & (uint64_t{1} << bit)) {
+          for (int i = 0; i < 4; ++i) {
+            state[i] ^= m_state[i];
+          }
+        }
+        next();
+      }
+    }
+    for (int i = 0; i < 4; ++i) {
+      m_state[i] = state[i];
+    }
+  }
+
+ private:
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  uint64_t m_state[4];
+};
+
+}  // namespace ev
@@ -1,15 +1,19 @@
 #define _USE_MATH_DEFINES
 #include "shapes.h"
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <stdexcept>
+#include <string>
 #include "common.h"
 
 namespace ev {
-Vec2 Polygon::getExtremePoint(Vec2 dir) {
+Vec2 Polygon::getExtremePoint(Vec2 dir) const {
   real best_projection = -std::numeric_limits<real>::infinity();
   Vec2 best_vertex{};
 
-  for (uint32 i = 0; i < m_vertices.size(); ++i) {
-    Vec2 v = m_vertices[i];
+  for (uint32 i = 0; i < m_vertex_count; ++i) {
+    Vec2 v = m_vertices[i].pos;
     real projection = dot_product(v, dir);
 
     if (projection > best_projection) {
@@ -22,26 +26,35 @@ Vec2 Polygon::getExtremePoint(Vec2 dir) {
 }
 
 // Must be in a counterclockwise order around (0, 0)
-Polygon::Polygon(std::vector<Vec2> vertices, real rotation_rad) {
-  assert(vertices.size() >= 3);
-  m_vertices = std::move(vertices);
+Polygon::Polygon(const std::vector<Vec2>& vertices, real rotation_rad)
+    : m_rotation{rotation_rad} {
+  // Checked in release builds too, more vertices would overrun m_vertices
+  if (vertices.size() < 3 || vertices.size() > max_vertices) {
+    throw std::invalid_argument("Polygon needs 3 to " +
+                                std::to_string(max_vertices) + " vertices");
+  }
+  m_vertex_count = static_cast<uint32>(vertices.size());
+  for (uint32 i = 0; i < m_vertex_count; ++i) {
+    m_vertices[i].pos = vertices[i];
+  }
   compute_face_normals();
+  compute_mass_properties();
 }
 
-tuple<real, real> Polygon::compute_mass(real density) {
+void Polygon::compute_mass_properties() {
   Vec2 center_of_mass{0.0f, 0.0f};
   real area = 0.0f;
   real moment_of_inertia = 0.0f;
 
-  for (uint32 i_1 = 0; i_1 < m_vertices.size(); ++i_1) {
+  for (uint32 i_1 = 0; i_1 < m_vertex_count; ++i_1) {
     // Calculate the area of the triangle made up by a polygon face and (0,0)
     // Note that we are assuming (0, 0) is inside the polygon (an invariant of
     // Polygon)
 
-    uint32 i_2 = (i_1 + 1) % m_vertices.size();  // Wrap around
+    uint32 i_2 = (i_1 + 1) % m_vertex_count;  // Wrap around
 
-    Vec2& p1 = m_vertices[i_1];
-    Vec2& p2 = m_vertices[i_2];
+    Vec2& p1 = m_vertices[i_1].pos;
+    Vec2& p2 = m_vertices[i_2].pos;
 
     constexpr real over_3 = 1.0f / 3.0f;
 
@@ -62,37 +75,61 @@ tuple<real, real> Polygon::compute_mass(real density) {
   center_of_mass.y *= 1.0f / area;
 
   // Move (0,0) to center of mass
-  for (auto& vertex : m_vertices) {
-    vertex -= center_of_mass;
+  for (uint32 i = 0; i < m_vertex_count; ++i) {
+    m_vertices[i].pos -= center_of_mass;
   }
   m_pos += center_of_mass;
 
-  moment_of_inertia = moment_of_inertia * density;
-  real mass = density * area;
-  return {mass, moment_of_inertia};
+  // The sum above is around the old origin, move it to the center of mass
+  // with the parallel axis theorem
+  m_area = area;
+  m_unit_inertia =
+      moment_of_inertia - area * center_of_mass.length_squared();
+}
+
+void Polygon::update_world_cache(Vec2 body_pos, const Rot& body_orientation) {
+  Vec2 center = body_pos + body_orientation.rotate(m_pos);
+  Rot rotation = body_orientation * m_rotation;
+
+  for (uint32 i = 0; i < m_vertex_count; ++i) {
+    m_world_vertices[i].pos = center + rotation.rotate(m_vertices[i].pos);
+    m_world_vertices[i].normal = rotation.rotate(m_vertices[i].normal);
+  }
+}
+
+AABB Polygon::compute_aabb() const {
+  AABB aabb{m_world_vertices[0].pos, m_world_vertices[0].pos};
+  for (uint32 i = 1; i < m_vertex_count; ++i) {
+    const Vec2& v = m_world_vertices[i].pos;
+    aabb.min.x = fmin(aabb.min.x, v.x);
+    aabb.min.y = fmin(aabb.min.y, v.y);
+    aabb.max.x = fmax(aabb.max.x, v.x);
+    aabb.max.y = fmax(aabb.max.y, v.y);
+  }
+  return aabb;
 }
 
 void Polygon::compute_face_normals() {
-  for (uint32 i1 = 0; i1 < m_vertices.size(); ++i1) {
-    uint32 i2 = i1 + 1 < m_vertices.size() ? i1 + 1 : 0;
-    Vec2 face = m_vertices[i2] - m_vertices[i1];
+  for (uint32 i1 = 0; i1 < m_vertex_count; ++i1) {
+    uint32 i2 = i1 + 1 < m_vertex_count ? i1 + 1 : 0;
+    Vec2 face = m_vertices[i2].pos - m_vertices[i1].pos;
 
     // Ensure no zero-length edges, because that's bad
     assert(face.length_squared() > 0.00000000001);
 
     // Calculate normal with 2D cross product between vector and scalar
-    m_normals[i1] = Vec2{face.y, -face.x};
-    m_normals[i1].normalize();
+    m_vertices[i1].normal = Vec2{face.y, -face.x};
+    m_vertices[i1].normal.normalize();
   }
 }
 
-Polygon::Polygon(real half_width, real half_height, real rotation_rad) {
+Polygon::Polygon(real half_width, real half_height, real rotation_rad)
+    : m_rotation{rotation_rad} {
   set_rect(half_width, half_height);
-  m_rotation = rotation_rad;
 }
 
 void Polygon::set_rect(real half_width, real half_height) {
-  //  The m_vertices and m_normals data for a rectangle:
+  //  The vertex and normal data for a rectangle:
   //    y
   //    ^
   //    |
@@ -108,24 +145,77 @@ void Polygon::set_rect(real half_width, real half_height) {
   //                   |
   //                   V
 
-  m_vertices.resize(4);
-  m_vertices[0] = {-half_width, -half_height};
-  m_vertices[1] = {half_width, -half_height};
-  m_vertices[2] = {half_width, half_height};
-  m_vertices[3] = {-half_width, half_height};
+  m_vertex_count = 4;
+  m_is_box = true;
+  m_half_extents = Vec2{half_width, half_height};
+  m_vertices[0].pos = {-half_width, -half_height};
+  m_vertices[1].pos = {half_width, -half_height};
+  m_vertices[2].pos = {half_width, half_height};
+  m_vertices[3].pos = {-half_width, half_height};
+
+  m_vertices[0].normal = {0.0f, -1.0f};
+  m_vertices[1].normal = {1.0f, 0.0f};
+  m_vertices[2].normal = {0.0f, 1.0f};
+  m_vertices[3].normal = {-1.0f, 0.0f};
+
+  compute_mass_properties();
+}
+
+AABB Circle::compute_aabb(Vec2 body_pos, const Rot& body_orientation) const {
+  Vec2 center = body_pos + body_orientation.rotate(m_pos);
+  Vec2 extent{radius, radius};
+  return AABB{center - extent, center + extent};
+}
+
+void Plane::update_world_cache(Vec2 body_pos, const Rot& body_orientation) {
+  m_world_normal = body_orientation.rotate(m_normal);
+  m_world_offset = dot_product(m_world_normal,
+                               body_pos + body_orientation.rotate(m_pos));
+}
+
+Heightfield::Heightfield(std::vector<real> heights, real spacing)
+    : m_heights{std::move(heights)}, m_spacing{spacing} {
+  assert(m_heights.size() >= 2 && spacing > 0.0f);
+  m_max_height = *std::max_element(m_heights.begin(), m_heights.end());
+}
+
+void Heightfield::update_world_cache(Vec2 body_pos) {
+  m_world_origin = body_pos + m_pos;
+}
+
+Vec2 Heightfield::segment_normal(uint32_t index) const {
+  Vec2 normal{m_heights[index] - m_heights[index + 1], m_spacing};
+  normal.normalize();
+  return normal;
+}
+
+bool Heightfield::segment_range(real min_x,
+                                real max_x,
+                                uint32_t& first,
+                                uint32_t& last) const {
+  real segment_count = static_cast<real>(m_heights.size() - 1);
+  real min_segment = floor((min_x - m_world_origin.x) / m_spacing);
+  real max_segment = floor((max_x - m_world_origin.x) / m_spacing);
+  if (max_segment < 0.0f || min_segment >= segment_count) {
+    return false;
+  }
+  first = static_cast<uint32_t>(fmax(min_segment, 0.0f));
+  last = static_cast<uint32_t>(fmin(max_segment + 1.0f, segment_count));
+  return true;
+}
 
-  m_normals.resize(4);
-  m_normals[0] = {0.0f, -1.0f};
-  m_normals[1] = {1.0f, 0.0f};
-  m_normals[2] = {0.0f, 1.0f};
-  m_normals[3] = {-1.0f, 0.0f};
+AABB Heightfield::compute_aabb() const {
+  constexpr real huge = 1e30f;
+  real length = (m_heights.size() - 1) * m_spacing;
+  return AABB{Vec2{m_world_origin.x, -huge},
+              Vec2{m_world_origin.x + length, m_world_origin.y + m_max_height}};
 }
 
-real Circle::compute_mass(real density) {
+real Circle::compute_mass(real density) const {
   // I'll let the mass scale in 3D for more realistic looking physics
   return M_PI * radius * radius * radius * density * 4.0 / 3.0;
 }
-real Circle::compute_angular_mass(real mass) {
+real Circle::compute_angular_mass(real mass) const {
   return mass * radius * radius * 2.0 / 5.0;  // Assuming uniform density
   // TODO: Maybe add mass as if they were 3D objects?
 }
@@ -1,6 +1,7 @@
 #pragma once
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/mat4x4.hpp>
+#include <array>
+#include <cstdint>
+#include <tuple>
 #include <vector>
 #include "ev_math.h"
 namespace ev {
@@ -15,32 +16,142 @@ class Shape {
 };
 
 class Polygon : public Shape {
+ public:
+  static constexpr uint32_t max_vertices = 8;
+
  private:
-  real m_rotation{};
+  // A vertex and the normal of the face starting at it, interleaved so the
+  // SAT loops read both from the same cache line
+  struct Vertex {
+    Vec2 pos;
+    Vec2 normal;
+  };
+
+  Rot m_rotation{};
+
+  // Stored inline so polygons never touch the heap after construction
+  std::array<Vertex, max_vertices> m_vertices{};
+  std::array<Vertex, max_vertices> m_world_vertices{};  // update_world_cache
+  uint32_t m_vertex_count{0};
+
+  // Set for rectangles made by set_rect, lets collision take a box-box path
+  bool m_is_box{false};
+  Vec2 m_half_extents{};
+
+  // Area and moment of inertia around the centroid, at unit density. They
+  // only depend on the vertices, so they are computed once on construction.
+  real m_area{};
+  real m_unit_inertia{};
 
   void compute_face_normals();
+  // Moves the local origin to the centroid and caches the area and inertia
+  void compute_mass_properties();
 
  public:
-  Polygon(std::vector<Vec2> vertices, real rotation_rad = 0.0f);
+  // Throws std::invalid_argument unless there are 3 to max_vertices vertices
+  Polygon(const std::vector<Vec2>& vertices, real rotation_rad = 0.0f);
   Polygon(real half_width, real half_height, real rotation_rad = 0.0f);
   void set_rect(real half_width, real half_height);
-  Vec2 getExtremePoint(Vec2 dir);
-  real inline rotation() const { return m_rotation; }
-  Vec2 inline vertex(int index) const { return m_vertices[index]; }
-  Vec2 inline normal(int index) const { return m_normals[index]; }
-  size_t inline vertex_count() const { return m_vertices.size(); }
+  Vec2 getExtremePoint(Vec2 dir) const;
+  const Rot& rotation() const { return m_rotation; }
+  Vec2 inline vertex(int index) const { return m_vertices[index].pos; }
+  Vec2 inline normal(int index) const { return m_vertices[index].normal; }
+  uint32_t inline vertex_count() const { return m_vertex_count; }
+  bool inline is_box() const { return m_is_box; }
+  Vec2 inline half_extents() const { return m_half_extents; }
+
+  // Transforms the vertices and normals into world space. Done once per step
+  // by World::step right after the bodies have moved.
+  void update_world_cache(Vec2 body_pos, const Rot& body_orientation);
+  Vec2 inline world_vertex(int index) const {
+    return m_world_vertices[index].pos;
+  }
+  Vec2 inline world_normal(int index) const {
+    return m_world_vertices[index].normal;
+  }
 
-  std::vector<Vec2> m_vertices{};
-  std::vector<Vec2> m_normals{};
+  // World-space bounds, from the cached world vertices
+  AABB compute_aabb() const;
 
-  // Returns {mass, angular_mass} tuple
-  tuple<real, real> compute_mass(real density);
+  // Returns {mass, angular_mass} tuple, angular mass around the centroid
+  tuple<real, real> compute_mass(real density) const {
+    return {density * m_area, density * m_unit_inertia};
+  }
+  real inline mass(real density) const { return density * m_area; }
 };
 
 class Circle : public Shape {
  public:
   real radius;
-  real compute_mass(real density);
-  real compute_angular_mass(real mass);
+  AABB compute_aabb(Vec2 body_pos, const Rot& body_orientation) const;
+  real compute_mass(real density) const;
+  real compute_angular_mass(real mass) const;
+};
+
+// A static half-space: everything behind the line through m_pos with normal
+// m_normal (both in body space) is solid. Used for flat ground, where contacts
+// against it only need one projection per vertex. Bodies with planes are
+// meant to be fixed, and are seen as overlapping everything by the
+// broadphase.
+class Plane : public Shape {
+ public:
+  Plane(Vec2 normal = Vec2{0.0f, 1.0f}) : m_normal{normal} {}
+
+  Vec2 m_normal{0.0f, 1.0f};
+
+  void update_world_cache(Vec2 body_pos, const Rot& body_orientation);
+  Vec2 inline world_normal() const { return m_world_normal; }
+
+  // Signed distance from the plane, negative inside
+  real inline distance(Vec2 world_point) const {
+    return dot_product(m_world_normal, world_point) - m_world_offset;
+  }
+
+ private:
+  Vec2 m_world_normal{0.0f, 1.0f};
+  real m_world_offset{};
+};
+
+// Fixed terrain: heights sampled every `spacing` along x, starting at m_pos in
+// body space, joined into a piecewise linear surface with solid ground below.
+// Heightfields stay axis aligned (the body orientation is ignored) and, like
+// planes, belong on fixed bodies. Collision only looks at the samples under
+// the other shape, so the cost does not grow with the terrain length.
+class Heightfield : public Shape {
+ public:
+  Heightfield(std::vector<real> heights, real spacing);
+
+  void update_world_cache(Vec2 body_pos);
+
+  uint32_t inline sample_count() const {
+    return static_cast<uint32_t>(m_heights.size());
+  }
+  real inline spacing() const { return m_spacing; }
+  const std::vector<real>& heights() const { return m_heights; }
+
+  Vec2 inline world_point(uint32_t index) const {
+    return Vec2{m_world_origin.x + index * m_spacing,
+                m_world_origin.y + m_heights[index]};
+  }
+
+  // Upwards unit normal of segment index, which runs from sample index to
+  // index + 1
+  Vec2 segment_normal(uint32_t index) const;
+
+  // Finds the segments [first, last) overlapping the world x range.
+  // Returns false if the range misses the heightfield.
+  bool segment_range(real min_x,
+                     real max_x,
+                     uint32_t& first,
+                     uint32_t& last) const;
+
+  // Reaches down "forever" since everything under the surface is solid
+  AABB compute_aabb() const;
+
+ private:
+  std::vector<real> m_heights;
+  real m_spacing;
+  real m_max_height{};
+  Vec2 m_world_origin{};  // World position of sample 0 at height 0
 };
 }  // namespace ev
@@ -1,80 +1,377 @@
 #pragma once
+#include <cassert>
+#include <cstring>
 #include "physics_2d.h"
 #include "shapes.h"
+#include "terrain.h"
 
 namespace ev {
 
+enum class GroundType { flat, terrain };
+
+// Why a challenge ended
+enum class Termination {
+  running,
+  completed,  // Ran for the full length
+  at_rest,    // The creature stopped getting anywhere
+  exploded,   // The simulation blew up
+};
+
+struct ChallengeConfig {
+  int seconds{15};
+  int nr_bodies{0};  // Random boxes dropped into the world
+  uint64_t seed{0};  // Placement of the random boxes
+  phys::BroadphaseType broadphase{phys::BroadphaseType::sweep_and_prune};
+  GroundType ground{GroundType::flat};
+  uint64_t terrain_seed{0};  // Only used with GroundType::terrain
+  phys::SolverConfig solver{};
+
+  // The creature is at rest once it has stayed within rest_distance of one
+  // spot for rest_seconds. The contacts never quite settle, so this looks at
+  // the position rather than at the kinetic energy. 0 turns it off.
+  real rest_seconds{10.0f};
+  real rest_distance{0.5f};
+  // The world has exploded when any body is NaN or inf, or when the total
+  // kinetic energy goes above this
+  real max_kinetic_energy{1e7f};
+  real exploded_fitness{-1000.0f};  // Below any creature that walks backwards
+};
+
+// Changes whenever anything that decides the outcome of a challenge does
+inline uint64_t fingerprint(const ChallengeConfig& config, float dt) {
+  auto bits = [](auto value) {
+    uint64_t result = 0;
+    std::memcpy(&result, &value, sizeof(value));
+    return result;
+  };
+  const uint64_t fields[] = {static_cast<uint64_t>(config.seconds),
+                             static_cast<uint64_t>(config.nr_bodies),
+                             config.seed,
+                             static_cast<uint64_t>(config.broadphase),
+                             static_cast<uint64_t>(config.ground),
+                             config.terrain_seed,
+                             static_cast<uint64_t>(config.solver.type),
+                             config.solver.iterations,
+                             config.solver.warm_starting,
+                             bits(config.solver.baumgarte),
+                             bits(config.solver.slop),
+                             bits(config.solver.max_push_velocity),
+                             bits(config.solver.restitution_threshold),
+                             bits(config.solver.friction),
+                             bits(config.rest_seconds),
+                             bits(config.rest_distance),
+                             bits(config.max_kinetic_energy),
+                             bits(config.exploded_fitness),
+                             bits(dt)};
+  uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a, one field at a time
+  for (uint64_t field : fields) {
+    hash = (hash ^ field) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// How a creature is doing in a challenge, and how it ended
+struct CreatureProgress {
+  Termination termination{Termination::running};
+  real fitness{0.0f};  // Set once the challenge has ended
+  // Where the creature was when it last moved more than rest_distance
+  real rest_x{0.0f};
+  real rest_time{0.0f};
+
+  // Checks the ways a challenge ends after a step that left the creature at
+  // x. Returns true once it has.
+  bool update(const ChallengeConfig& config,
+              real x,
+              bool exploded,
+              bool last_step,
+              float dt);
+};
+
+inline bool CreatureProgress::update(const ChallengeConfig& config,
+                                     real x,
+                                     bool exploded,
+                                     bool last_step,
+                                     float dt) {
+  if (exploded) {
+    termination = Termination::exploded;
+    fitness = config.exploded_fitness;
+    return true;
+  }
+  if (last_step) {
+    termination = Termination::completed;
+    fitness = x;
+    return true;
+  }
+  if (abs(x - rest_x) > config.rest_distance) {
+    rest_x = x;
+    rest_time = 0.0f;
+  } else if (config.rest_seconds > 0.0f) {
+    rest_time += dt;
+    if (rest_time >= config.rest_seconds) {
+      termination = Termination::at_rest;
+      fitness = x;
+      return true;
+    }
+  }
+  return false;
+}
+
 template <class T>
 class WalkingChallenge {
  public:
   using CreatureType = T;
-  WalkingChallenge(CreatureDNA creatureDNA,
-                   int seconds = 15,
-                   int nr_bodies = 0);
 
-  // Returns true if challenge is done
+  // Everything needed to pick the challenge up again from some step
+  struct Snapshot {
+    phys::WorldSnapshot world{};
+    typename CreatureType::State creature{};
+    int num_iterations{0};
+    CreatureProgress progress{};
+  };
+
+  WalkingChallenge(CreatureDNA creatureDNA, ChallengeConfig config = {});
+
+  // Returns true if challenge is done, which is early if the creature comes to
+  // rest or the simulation explodes
   bool step(float dt);
 
   // Only call after simulation is done (ie. step returns true)
   real get_fitness();
+  Termination termination() const { return m_progress.termination; }
+  // The fitness the creature has reached so far, for checkpoints
+  real partial_fitness();
+  int steps_done() const { return m_num_iterations; }
+  int steps_left() const { return m_iterations_to_complete - m_num_iterations; }
 
   void reset(CreatureDNA new_creatureDNA);
   phys::World& getWorld();
 
+  // Reuses the storage of snapshot, so saving into it again doesn't allocate
+  void save(Snapshot& snapshot) const;
+  // Only restore into a challenge for the same DNA and config, which has the
+  // same bodies. Cheaper than reset() and stepping back up to the snapshot.
+  void restore(const Snapshot& snapshot);
+
  private:
   std::unique_ptr<CreatureType> m_creature;
-  Body m_ground{{0.0f, -50.0f}, {}, Polygon{5000.0f, 50.0f}, true};
+  // The body the creature walks on, m_flat_ground or m_terrain
+  Body& ground();
+
+  ChallengeConfig m_config;
+  Body m_flat_ground{{0.0f, 0.0f}, Plane{{0.0f, 1.0f}}};
+  std::unique_ptr<Body> m_terrain{};
   phys::World m_world;
   int m_num_iterations{0};
   int m_iterations_to_complete{};
-  int m_nr_bodies{};
+  CreatureProgress m_progress{};
   static constexpr float m_dt = 1.0f / 60.0f;
 };
 
 template <class T>
 WalkingChallenge<T>::WalkingChallenge(CreatureDNA creatureDNA,
-                                      int seconds,
-                                      int nr_bodies) {
-  m_nr_bodies = nr_bodies;
-  m_iterations_to_complete = 60 * seconds;
+                                      ChallengeConfig config)
+    : m_config{config}, m_world{config.broadphase, config.solver} {
+  m_iterations_to_complete = 60 * config.seconds;
   m_creature = std::make_unique<CreatureType>(creatureDNA);
 
-  m_world.add(&m_ground);
+  if (config.ground == GroundType::terrain) {
+    m_terrain = std::make_unique<Body>(
+        Vec2{0.0f, 0.0f}, generate_terrain(config.terrain_seed));
+  }
+
+  m_world.add(&ground());
   m_world.add(&m_creature->body());
-  m_world.add_random_bodies(nr_bodies);
+  m_progress.rest_x = m_creature->body().m_pos.x;
+  m_world.add_random_bodies(config.nr_bodies, config.seed);
+}
+
+template <class T>
+Body& WalkingChallenge<T>::ground() {
+  return m_terrain ? *m_terrain : m_flat_ground;
 }
 
 template <class T>
 bool WalkingChallenge<T>::step(float dt) {
-  if (m_num_iterations < m_iterations_to_complete) {
-    m_creature->step(dt);
-    m_world.step(dt);
-    ++m_num_iterations;
+  if (m_progress.termination != Termination::running) {
+    return true;
   }
-  return m_num_iterations == m_iterations_to_complete;
+  m_creature->step(dt);
+  m_world.step(dt);
+  ++m_num_iterations;
+
+  // Written so a NaN energy counts as exploded too
+  bool exploded = !m_world.is_finite() ||
+                  !(m_world.kinetic_energy() <= m_config.max_kinetic_energy);
+  return m_progress.update(m_config, m_creature->body().m_pos.x, exploded,
+                           m_num_iterations == m_iterations_to_complete, dt);
 }
 
 template <class T>
 real WalkingChallenge<T>::get_fitness() {
-  assert(m_num_iterations == m_iterations_to_complete);
+  assert(m_progress.termination != Termination::running);
+  return m_progress.fitness;
+}
+
+template <class T>
+real WalkingChallenge<T>::partial_fitness() {
   return m_creature->body().m_pos.x;
 }
 
 template <class T>
 void WalkingChallenge<T>::reset(CreatureDNA new_creatureDNA) {
   m_num_iterations = 0;
+  m_progress = CreatureProgress{};
 
   m_world.reset();
 
   m_creature = std::make_unique<CreatureType>(new_creatureDNA);
 
-  m_world.add(&m_ground);
+  m_world.add(&ground());
   m_world.add(&m_creature->body());
-  m_world.add_random_bodies(m_nr_bodies);
+  m_progress.rest_x = m_creature->body().m_pos.x;
+  m_world.add_random_bodies(m_config.nr_bodies, m_config.seed);
 }
 
 template <class T>
 phys::World& WalkingChallenge<T>::getWorld() {
   return m_world;
 }
+
+template <class T>
+void WalkingChallenge<T>::save(Snapshot& snapshot) const {
+  m_world.save(snapshot.world);
+  snapshot.creature = m_creature->state();
+  snapshot.num_iterations = m_num_iterations;
+  snapshot.progress = m_progress;
+}
+
+template <class T>
+void WalkingChallenge<T>::restore(const Snapshot& snapshot) {
+  m_world.restore(snapshot.world);
+  m_creature->set_state(snapshot.creature);
+  m_num_iterations = snapshot.num_iterations;
+  m_progress = snapshot.progress;
+}
+
+// Runs the walking challenge for a whole batch of creatures in one world.
+// They share the ground, the random bodies and the broadphase, and collision
+// filtering keeps them from touching each other, so each one walks as if it
+// were alone with the ground. Saves the fixed cost of a world per creature,
+// but every stage of a step now walks the shapes of all creatures, which
+// stops fitting in cache at a few hundred of them. Past that it is slower
+// than a WalkingChallenge each; PopulationWorld is the fast batched path.
+//
+// Without random bodies every creature gets the same fitness as in its own
+// WalkingChallenge. With them the creatures push the same boxes around, so
+// the results differ. Only the creature's own body counts towards exploding.
+template <class T>
+class WalkingBatchChallenge {
+ public:
+  using CreatureType = T;
+
+  // Creatures are in this category and collide with all others
+  static constexpr uint32 creature_category = 1u << 1;
+
+  WalkingBatchChallenge(const std::vector<CreatureDNA>& dna,
+                        ChallengeConfig config = {});
+
+  // Returns true once the challenge is done for every creature. Creatures are
+  // taken out of the world as they finish.
+  bool step(float dt);
+
+  uint32 size() const { return static_cast<uint32>(m_creatures.size()); }
+  // Only call once the creature is done
+  real get_fitness(uint32 creature) const;
+  Termination termination(uint32 creature) const {
+    return m_progress[creature].termination;
+  }
+  real partial_fitness(uint32 creature) {
+    return m_creatures[creature]->body().m_pos.x;
+  }
+  int steps_done() const { return m_num_iterations; }
+  uint32 running() const { return m_running; }
+
+  phys::World& getWorld() { return m_world; }
+
+ private:
+  ChallengeConfig m_config;
+  Body m_flat_ground{{0.0f, 0.0f}, Plane{{0.0f, 1.0f}}};
+  std::unique_ptr<Body> m_terrain{};
+  phys::World m_world;
+  std::vector<std::unique_ptr<CreatureType>> m_creatures{};
+  std::vector<CreatureProgress> m_progress{};
+  std::vector<Body*> m_finished{};  // Creatures that finished this step
+  uint32 m_running{0};
+  int m_num_iterations{0};
+  int m_iterations_to_complete{};
+};
+
+template <class T>
+WalkingBatchChallenge<T>::WalkingBatchChallenge(
+    const std::vector<CreatureDNA>& dna,
+    ChallengeConfig config)
+    : m_config{config}, m_world{config.broadphase, config.solver} {
+  m_iterations_to_complete = 60 * config.seconds;
+  if (config.ground == GroundType::terrain) {
+    m_terrain = std::make_unique<Body>(
+        Vec2{0.0f, 0.0f}, generate_terrain(config.terrain_seed));
+    m_world.add(m_terrain.get());
+  } else {
+    m_world.add(&m_flat_ground);
+  }
+
+  m_progress.resize(dna.size());
+  for (uint32 i = 0; i < dna.size(); ++i) {
+    m_creatures.push_back(std::make_unique<CreatureType>(dna[i]));
+    Body& body = m_creatures[i]->body();
+    body.m_filter = {creature_category, ~creature_category};
+    m_world.add(&body);
+    m_progress[i].rest_x = body.m_pos.x;
+  }
+  m_running = size();
+  m_world.add_random_bodies(config.nr_bodies, config.seed);
+}
+
+template <class T>
+bool WalkingBatchChallenge<T>::step(float dt) {
+  if (m_running == 0) {
+    return true;
+  }
+  for (uint32 i = 0; i < size(); ++i) {
+    if (m_progress[i].termination == Termination::running) {
+      m_creatures[i]->step(dt);
+    }
+  }
+  m_world.step(dt);
+  ++m_num_iterations;
+
+  bool last_step = m_num_iterations == m_iterations_to_complete;
+  m_finished.clear();
+  for (uint32 i = 0; i < size(); ++i) {
+    if (m_progress[i].termination != Termination::running) {
+      continue;
+    }
+    Body& body = m_creatures[i]->body();
+    // Written so a NaN energy counts as exploded too
+    bool exploded = !body.is_finite() ||
+                    !(body.kinetic_energy() <= m_config.max_kinetic_energy);
+    if (m_progress[i].update(m_config, body.m_pos.x, exploded, last_step,
+                             dt)) {
+      m_finished.push_back(&body);
+      --m_running;
+    }
+  }
+  // All at once, every removal is a pass over the world
+  if (!m_finished.empty()) {
+    m_world.remove(m_finished);
+  }
+  return m_running == 0;
+}
+
+template <class T>
+real WalkingBatchChallenge<T>::get_fitness(uint32 creature) const {
+  assert(m_progress[creature].termination != Termination::running);
+  return m_progress[creature].fitness;
+}
+
 }  // namespace ev
@@ -0,0 +1,52 @@
+#define _USE_MATH_DEFINES
+#include "terrain.h"
+#include <cmath>
+
+namespace ev {
+
+Heightfield generate_terrain(uint64_t seed, const TerrainSettings& settings) {
+  uint32 sample_count =
+      static_cast<uint32>(settings.length / settings.spacing) + 1;
+  real start_x = -0.5f * (sample_count - 1) * settings.spacing;
+  vector<real> heights(sample_count, 0.0f);
+
+  Rng rng{seed};
+
+  // Each octave has random heights at lattice points, and cosine
+  // interpolation between them
+  constexpr int octaves = 4;
+  real wavelength = 64.0f;
+  real amplitude = settings.amplitude;
+  for (int octave = 0; octave < octaves; ++octave) {
+    uint32 lattice_count =
+        static_cast<uint32>(settings.length / wavelength) + 2;
+    vector<real> lattice(lattice_count);
+    for (real& height : lattice) {
+      height = amplitude * rng.uniform(-1.0f, 1.0f);
+    }
+
+    for (uint32 i = 0; i < sample_count; ++i) {
+      real t = i * settings.spacing / wavelength;
+      uint32 cell = static_cast<uint32>(t);
+      real blend = 0.5f - 0.5f * cos((t - cell) * M_PI);
+      heights[i] += (1.0f - blend) * lattice[cell] + blend * lattice[cell + 1];
+    }
+
+    wavelength *= 0.5f;
+    amplitude *= settings.roughness;
+  }
+
+  // Flatten around the start so every creature is dropped on the same ground
+  for (uint32 i = 0; i < sample_count; ++i) {
+    real x = fabs(start_x + i * settings.spacing);
+    real scale = fmin(
+        fmax((x - settings.flat_start) / settings.ramp_length, 0.0f), 1.0f);
+    heights[i] *= scale;
+  }
+
+  Heightfield heightfield{std::move(heights), settings.spacing};
+  heightfield.m_pos = Vec2{start_x, 0.0f};
+  return heightfield;
+}
+
+}  // namespace ev
@@ -0,0 +1,22 @@
+#pragma once
+#include "common.h"
+#include "rng.h"
+#include "shapes.h"
+
+namespace ev {
+
+struct TerrainSettings {
+  real length{2000.0f};     // Centered on x = 0
+  real spacing{1.0f};       // Distance between the height samples
+  real amplitude{4.0f};     // Height of the largest hills
+  real roughness{0.45f};    // Amplitude falloff from one octave to the next
+  real flat_start{10.0f};   // Flat ground within this distance of x = 0 ...
+  real ramp_length{40.0f};  // ... blending into full height over this
+};
+
+// Rolling hills made from a few octaves of smoothed value noise. The same
+// seed always gives the same terrain, so challenges stay comparable.
+Heightfield generate_terrain(uint64_t seed,
+                             const TerrainSettings& settings = {});
+
+}  // namespace ev
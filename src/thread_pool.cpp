@@ -0,0 +1,204 @@
+#include "thread_pool.h"
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <pmmintrin.h>
+#endif
+
+namespace ev {
+
+namespace {
+// Lets submit() tell if it is called from one of the pool's own tasks
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local uint32 t_worker = 0;
+
+// Creatures coming to rest leave tiny velocities behind, and on x86 every
+// operation on a denormal takes a slow microcode path. Flushing them to zero
+// costs nothing we care about. The MXCSR flags are per thread.
+void flush_denormals_to_zero() {
+#if defined(__SSE2__) || defined(_M_X64)
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+  _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+#endif
+}
+}  // namespace
+
+uint32 ThreadPool::default_thread_count() {
+  uint32 cores = std::thread::hardware_concurrency();
+  return std::max(cores, 2u) - 1;
+}
+
+ThreadPool::ThreadPool(uint32 thread_count) {
+  thread_count = std::max(thread_count, 1u);
+  for (uint32 i = 0; i < thread_count; ++i) {
+    m_workers.push_back(std::make_unique<Worker>());
+  }
+  m_stats_start = std::chrono::steady_clock::now();
+  // Start the threads last, they look at every worker's deque
+  for (uint32 i = 0; i < thread_count; ++i) {
+    m_workers[i]->thread = std::thread{[this, i] { worker_loop(i); }};
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_stopping = true;
+  }
+  m_task_available.notify_all();
+  for (auto& worker : m_workers) {
+    worker->thread.join();
+  }
+}
+
+void ThreadPool::submit(Task task) {
+  ++m_unfinished;
+  uint32 worker = t_pool == this
+                      ? t_worker
+                      : m_next_worker.fetch_add(1) % thread_count();
+  push(worker, std::move(task));
+}
+
+void ThreadPool::push(uint32 worker, Task task) {
+  {
+    std::lock_guard<std::mutex> lock{m_workers[worker]->mutex};
+    m_workers[worker]->tasks.push_back(std::move(task));
+  }
+  {
+    // Under m_mutex so a worker can't check m_queued and then miss the notify
+    std::lock_guard<std::mutex> lock{m_mutex};
+    ++m_queued;
+  }
+  m_task_available.notify_one();
+}
+
+bool ThreadPool::pop_local(uint32 worker, Task& task) {
+  Worker& self = *m_workers[worker];
+  std::lock_guard<std::mutex> lock{self.mutex};
+  if (self.tasks.empty()) {
+    return false;
+  }
+  task = std::move(self.tasks.back());
+  self.tasks.pop_back();
+  --m_queued;
+  return true;
+}
+
+bool ThreadPool::steal(uint32 thief, Task& task) {
+  // Start at the next worker, so the thieves don't all pile onto worker 0
+  for (uint32 i = 1; i < thread_count(); ++i) {
+    Worker& victim = *m_workers[(thief + i) % thread_count()];
+    std::lock_guard<std::mutex> lock{victim.mutex};
+    if (!victim.tasks.empty()) {
+      // Take the oldest task, the owner is busy with the newest ones
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --m_queued;
+      ++m_workers[thief]->steals;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::wait_idle() {
+  std::unique_lock<std::mutex> lock{m_mutex};
+  m_idle.wait(lock, [this] { return m_unfinished == 0; });
+}
+
+void ThreadPool::parallel_for(uint32 count,
+                              uint32 chunk_size,
+                              const RangeTask& task) {
+  struct Progress {
+    std::atomic<uint32> next{0};  // First item of the next chunk to take
+    std::atomic<uint32> done{0};
+  };
+  // Shared, since helpers that only get to run after everything is done
+  // still look at it. They find no chunk left and never touch task.
+  auto progress = std::make_shared<Progress>();
+  auto take_chunks = [progress, count, chunk_size, &task]() {
+    uint32 begin;
+    while ((begin = progress->next.fetch_add(chunk_size)) < count) {
+      uint32 end = std::min(begin + chunk_size, count);
+      task(begin, end);
+      progress->done += end - begin;
+    }
+  };
+
+  bool caller_helps = t_pool == this;
+  uint32 chunks = (count + chunk_size - 1) / chunk_size;
+  uint32 helpers = std::min(thread_count(), chunks) - (caller_helps ? 1 : 0);
+  for (uint32 i = 0; i < helpers; ++i) {
+    submit([take_chunks](uint32) { take_chunks(); });
+  }
+  if (caller_helps) {
+    take_chunks();
+  }
+  while (progress->done < count) {
+    std::this_thread::yield();
+  }
+}
+
+void ThreadPool::worker_loop(uint32 worker) {
+  t_pool = this;
+  t_worker = worker;
+  flush_denormals_to_zero();
+  Worker& self = *m_workers[worker];
+
+  Task task;
+  while (true) {
+    if (pop_local(worker, task) || steal(worker, task)) {
+      auto start = std::chrono::steady_clock::now();
+      task(worker);
+      task = nullptr;  // Release whatever the task captured right away
+      self.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+      ++self.tasks_run;
+
+      if (--m_unfinished == 0) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_idle.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_task_available.wait(lock,
+                          [this] { return m_stopping || m_queued > 0; });
+    if (m_stopping && m_queued == 0) {
+      return;
+    }
+  }
+}
+
+SchedulerStats ThreadPool::stats() const {
+  SchedulerStats stats{};
+  double elapsed_ns = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - m_stats_start)
+          .count());
+  double total_busy_ns = 0.0;
+  for (const auto& worker : m_workers) {
+    stats.tasks_run += worker->tasks_run;
+    stats.steals += worker->steals;
+    double busy_ns = static_cast<double>(worker->busy_ns.load());
+    total_busy_ns += busy_ns;
+    stats.worker_utilization.push_back(
+        elapsed_ns > 0.0 ? busy_ns / elapsed_ns : 0.0);
+  }
+  if (elapsed_ns > 0.0) {
+    stats.utilization = total_busy_ns / (elapsed_ns * thread_count());
+  }
+  return stats;
+}
+
+void ThreadPool::reset_stats() {
+  for (auto& worker : m_workers) {
+    worker->tasks_run = 0;
+    worker->steals = 0;
+    worker->busy_ns = 0;
+  }
+  m_stats_start = std::chrono::steady_clock::now();
+}
+
+}  // namespace ev
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+namespace ev {
+
+struct SchedulerStats {
+  uint64_t tasks_run{0};
+  uint64_t steals{0};  // Tasks taken from another worker's deque
+  // Fraction of the time since the last reset_stats() spent running tasks,
+  // over all workers and per worker
+  double utilization{0.0};
+  std::vector<double> worker_utilization{};
+};
+
+// Work-stealing scheduler. Every worker owns a deque: it pushes and pops its
+// own tasks at the back, and when it runs dry it steals from the front of the
+// other deques, so uneven task lengths even out instead of leaving cores idle
+// at the end of a batch. Tasks submitted from outside the pool are spread
+// round robin over the deques; tasks submitted from inside a task (like the
+// next chunk of a long job) go to the back of the current worker's deque.
+//
+// Tasks get the index of the worker running them.
+class ThreadPool {
+ public:
+  using Task = std::function<void(uint32 worker)>;
+  using RangeTask = std::function<void(uint32 begin, uint32 end)>;
+
+  // One thread per core, minus one for the main/render thread
+  static uint32 default_thread_count();
+
+  explicit ThreadPool(uint32 thread_count = default_thread_count());
+  ~ThreadPool();  // Finishes the queued tasks before joining
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(Task task);
+
+  // Blocks until all submitted tasks, and the tasks they submitted, are done
+  void wait_idle();
+
+  // Runs task on chunks of at most chunk_size out of [0, count) on the
+  // workers, and returns once every chunk is done. Called from one of the
+  // pool's own tasks, the calling worker takes chunks too, so it never waits
+  // on workers that are all busy with something else.
+  void parallel_for(uint32 count, uint32 chunk_size, const RangeTask& task);
+
+  uint32 thread_count() const { return static_cast<uint32>(m_workers.size()); }
+
+  SchedulerStats stats() const;
+  void reset_stats();
+
+ private:
+  struct Worker {
+    std::thread thread{};
+    std::mutex mutex{};
+    std::deque<Task> tasks{};
+
+    std::atomic<uint64_t> tasks_run{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<int64_t> busy_ns{0};
+  };
+
+  void worker_loop(uint32 worker);
+  void push(uint32 worker, Task task);
+  bool pop_local(uint32 worker, Task& task);
+  bool steal(uint32 thief, Task& task);
+
+  std::vector<std::unique_ptr<Worker>> m_workers{};
+  std::atomic<uint32> m_next_worker{0};  // Round robin for outside submits
+
+  // Sleeping workers wait on m_task_available until m_queued is non-zero
+  std::mutex m_mutex{};
+  std::condition_variable m_task_available{};
+  std::condition_variable m_idle{};
+  std::atomic<int64_t> m_queued{0};      // Tasks sitting in the deques
+  std::atomic<int64_t> m_unfinished{0};  // Submitted but not finished
+  bool m_stopping{false};
+
+  std::chrono::steady_clock::time_point m_stats_start{};
+};
+
+}  // namespace ev